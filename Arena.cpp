@@ -0,0 +1,45 @@
+#include <Arena.h>
+#include <algorithm>
+
+void* Arena::alloc(size_t bytes, size_t alignment) {
+    for (;;) {
+        if (current < blocks.size()) {
+            size_t start = (offset + alignment - 1) & ~(alignment - 1);
+            if (start + bytes <= blocks[current].size) {
+                offset = start + bytes;
+
+                // The bytes in use are what each block before this one held when it was left.
+                size_t in_use = offset;
+                for (size_t i = 0; i < current; i++) {
+                    in_use += blocks[i].used;
+                }
+                high_water = std::max(high_water, in_use);
+                return blocks[current].storage.get() + start;
+            }
+        }
+
+        // Moving on to the next block, replacing it if it is too small. Blocks past [current]
+        // hold nothing, since they are only reached again after a rewind.
+        size_t next = blocks.empty() ? 0 : current + 1;
+        size_t size = std::max({ kMinBlockSize, bytes + alignment, blocks.empty() ? 0 : 2 * blocks.back().size });
+        if (!blocks.empty()) blocks[current].used = offset;
+        if (next == blocks.size()) {
+            blocks.push_back({ std::unique_ptr<char[]>(new char[size]), size, 0 });
+        } else if (blocks[next].size < bytes + alignment) {
+            blocks[next] = { std::unique_ptr<char[]>(new char[size]), size, 0 };
+        }
+        current = next;
+        offset = 0;
+    }
+}
+
+void Arena::reset() {
+    if (blocks.size() > 1) {
+        // Allocations that each started a block may need padding once they share one.
+        size_t size = high_water + blocks.size() * alignof(std::max_align_t);
+        blocks.clear();
+        blocks.push_back({ std::unique_ptr<char[]>(new char[size]), size, 0 });
+    }
+    current = 0;
+    offset = 0;
+}
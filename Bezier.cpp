@@ -1,111 +1,115 @@
 #include <Bezier.h>
 #include <GPoint.h>
+#include <GPath.h>
+#include <algorithm>
 
 /**
- * Calculates #segments for quadratic bezier curves.
- * T = 0.25. 
- */ 
-int quadSegments(GPoint pts[]) {
+ * Calculates #segments for quadratic bezier curves, from Wang's formula.
+ *
+ * The flattening of a degree-d curve into n lines strays at most d(d - 1)/8 * M / n^2 from it,
+ * where M bounds the length of the second differences of the control points. For a quad
+ * M = |A - 2B + C|, so n = ceil(sqrt(M / (4 * tolerance))).
+ */
+int quadSegments(const GPoint pts[], float tolerance) {
     // Defining pts.
     GPoint A = pts[0];
     GPoint B = pts[1];
     GPoint C = pts[2];
 
-    // E = (-A + 2B - C) / 4.
-    GVector E = (-1*A + 2*B - C) * 0.25;
+    // M = |A - 2B + C|.
+    float M = ((A - B) + (C - B)).length();
 
-    // #segments = ceil(sqrt(E/T))
-    return ceil(2*sqrt(E.length()));
+    // #segments = ceil(sqrt(M / 4T)).
+    return ceil(sqrt(M / (4 * tolerance)));
 }
 
 /**
- * Calculates #segments for cubic bezier curves.
- * T = 0.25. 
+ * Calculates #segments for cubic bezier curves, from Wang's formula.
+ *
+ * For a cubic M = max(|A - 2B + C|, |B - 2C + D|), so n = ceil(sqrt(3M / (4 * tolerance))).
  */
-int cubicSegments(GPoint pts[]) {
+int cubicSegments(const GPoint pts[], float tolerance) {
     // Defining pts.
     GPoint A = pts[0];
     GPoint B = pts[1];
     GPoint C = pts[2];
     GPoint D = pts[3];
 
-    // P = -A + 2B - C.
-    GPoint P = -1*A + 2*B + C;
-    
-    // Q = -B + 2C - D.
-    GPoint Q = -1*B + 2*C - D;
+    // P = A - 2B + C.
+    GVector P = (A - B) + (C - B);
 
-    /* 
-     * E = { E.x, E.y }, where
-     * - E.x = max(abs(P.x), abs(Q.x));
-     * - E.y = max(abs(P.y), abs(Q.y));
-     */
-    GVector E;
-    float x = std::max(abs(P.fX), abs(Q.fX));
-    float y = std::max(abs(P.fY), abs(Q.fY));
-    E.set(x, y);
+    // Q = B - 2C + D.
+    GVector Q = (B - C) + (D - C);
 
-    // #segments = ceil(sqrt(E/T)).
-    return ceil(sqrt(3*E.length()));
-}
+    // M = max(|P|, |Q|).
+    float M = std::max(P.length(), Q.length());
 
-/**
- * Calculates a point on a quadratic bezier curve.
- * 
- * R(t) = (1 - t)^2 * A + 2t(1 -t) * B + t^2 * C.
- */
-GPoint calculateQuad(GPoint A, GPoint B, GPoint C, float t) {
-    return pow(1 - t, 2)*A + 2*t*(1 - t)*B + pow(t, 2)*C;
+    // #segments = ceil(sqrt(3M / 4T)).
+    return ceil(sqrt(3 * M / (4 * tolerance)));
 }
 
 /**
- * Calculates a point on a cubic bezier curve.
- * 
- * R(t) = (1 - t)^3 * A + 3t(1 - t)^2 * B + 3*t^2 * (1 - t) * C + t^3 * D.
+ * Chops a quadratic bezier at its y extremum.
+ *
+ * y'(t) = 0 at t = (A - B) / (A - 2B + C). The control points next to the extremum are set to
+ * its y, so float error can't turn a piece back on itself.
  */
-GPoint calculateCubic(GPoint A, GPoint B, GPoint C, GPoint D, float t) {
-    return pow(1 - t, 3)*A + 3*t*pow(1 - t, 2)*B + 3*pow(t, 2)*(1 - t)*C + pow(t, 3)*D;
+int chopQuadAtYExtrema(const GPoint src[3], GPoint dst[5]) {
+    float denom = src[0].fY - 2*src[1].fY + src[2].fY;
+    float t = denom == 0 ? 0 : (src[0].fY - src[1].fY) / denom;
+    if (!(t > 0 && t < 1)) {
+        std::copy(src, src + 3, dst);
+        return 1;
+    }
+
+    GPath::ChopQuadAt(src, dst, t);
+    dst[1].fY = dst[3].fY = dst[2].fY;
+    return 2;
 }
 
 /**
- * Creates the points on a quadratic bezier and returns them.
+ * Chops a cubic bezier at its y extrema.
+ *
+ * y'(t) / 3 = a*t^2 + 2b*t + c with a = -A + 3B - 3C + D, b = A - 2B + C and c = B - A. Its
+ * roots in (0, 1) are the extrema; the control points next to each one are set to its y.
  */
-void createQuadPts(GPoint pts[], GPoint quadPts[], int count) {
-    // Points.
-    GPoint A = pts[0];
-    GPoint B = pts[1];
-    GPoint C = pts[2];
+int chopCubicAtYExtrema(const GPoint src[4], GPoint dst[10]) {
+    float a = -src[0].fY + 3*src[1].fY - 3*src[2].fY + src[3].fY;
+    float b = 2*(src[0].fY - 2*src[1].fY + src[2].fY);
+    float c = src[1].fY - src[0].fY;
 
-    // Updating [quadPts] for each point on the curve.
-    quadPts[0] = A;
-    float inverse_count = pow(count, -1);
-    for (int i = 1; i < count; i++) {
-        // Inserting point.
-        float t = i * inverse_count;
-        GPoint new_point = calculateQuad(A, B, C, t);
-        quadPts[i] = new_point;
+    // Solving a*t^2 + b*t + c = 0 without cancellation.
+    float roots[2];
+    int count = 0;
+    if (a == 0) {
+        if (b != 0) roots[count++] = -c / b;
+    } else {
+        float disc = b*b - 4*a*c;
+        if (disc >= 0) {
+            float q = -0.5f * (b + (b < 0 ? -sqrt(disc) : sqrt(disc)));
+            roots[count++] = q / a;
+            if (q != 0) roots[count++] = c / q;
+        }
     }
-    quadPts[count] = C;
-}
 
-/**
- *  Creates the points on a cubic bezier and returns them.
- */
-void createCubicPts(GPoint pts[], GPoint cubicPts[], int count) {
-    // Points.
-    GPoint A = pts[0];
-    GPoint B = pts[1];
-    GPoint C = pts[2];
-    GPoint D = pts[3];
+    // Keeping the distinct roots in (0, 1), in order.
+    float ts[2];
+    int extrema = 0;
+    for (int i = 0; i < count; i++) {
+        if (roots[i] > 0 && roots[i] < 1) ts[extrema++] = roots[i];
+    }
+    if (extrema == 2) {
+        if (ts[0] > ts[1]) std::swap(ts[0], ts[1]);
+        if (ts[0] == ts[1]) extrema = 1;
+    }
 
-    // Updating [cubicPts] for each point on the curve.
-    cubicPts[0] = A;
-    float inverse_count = pow(count, -1);
-    for (int i = 1; i < count; i++) {
-        // Inserting point.
-        float t = i * inverse_count;
-        GPoint new_point = calculateCubic(A, B, C, D, t);
-        cubicPts[i] = new_point;
+    std::copy(src, src + 4, dst);
+    float start = 0;
+    for (int i = 0; i < extrema; i++) {
+        // The rest of the curve starts at dst[3i]; ChopCubicAt reads it before writing.
+        GPath::ChopCubicAt(dst + 3*i, dst + 3*i, (ts[i] - start) / (1 - start));
+        dst[3*i + 2].fY = dst[3*i + 4].fY = dst[3*i + 3].fY;
+        start = ts[i];
     }
-    cubicPts[count] = D;
-}
\ No newline at end of file
+    return extrema + 1;
+}
@@ -0,0 +1,188 @@
+#include <BlendSpan.h>
+#include <GBlendMode.h>
+#include <GPixel.h>
+#include <Simd.h>
+#include <algorithm>
+
+// Portable kernels: one pixel per block, one int per channel.
+namespace scalar {
+    const int N = 1;
+    typedef GPixel Px;
+    struct U16 { int c[4]; };   // b, g, r, a.
+
+    static inline Px load(const GPixel* src) { return *src; }
+    static inline void store(GPixel* dst, Px p) { *dst = p; }
+    static inline Px splat(GPixel p) { return p; }
+
+    static inline U16 widen(Px p) {
+        return {{ (int)(p & 0xFF), (int)((p >> 8) & 0xFF), (int)((p >> 16) & 0xFF), (int)(p >> 24) }};
+    }
+    static inline Px narrow(U16 v) {
+        return v.c[0] | (v.c[1] << 8) | (v.c[2] << 16) | ((GPixel)v.c[3] << 24);
+    }
+
+    static inline U16 add(U16 a, U16 b) { return {{ a.c[0] + b.c[0], a.c[1] + b.c[1], a.c[2] + b.c[2], a.c[3] + b.c[3] }}; }
+    static inline U16 mul(U16 a, U16 b) { return {{ a.c[0] * b.c[0], a.c[1] * b.c[1], a.c[2] * b.c[2], a.c[3] * b.c[3] }}; }
+    static inline U16 inv(U16 a) { return {{ 255 - a.c[0], 255 - a.c[1], 255 - a.c[2], 255 - a.c[3] }}; }
+    static inline U16 alpha(U16 a) { return {{ a.c[3], a.c[3], a.c[3], a.c[3] }}; }
+    static inline U16 zero() { return {{ 0, 0, 0, 0 }}; }
+
+    static inline U16 div255(U16 a) { return {{ Div255(a.c[0]), Div255(a.c[1]), Div255(a.c[2]), Div255(a.c[3]) }}; }
+
+    #include "BlendSpan.inc"
+}
+
+#if defined(G_SIMD_SSE2)
+// 4 pixels per block, held as two registers of 16-bit lanes.
+namespace sse2 {
+    const int N = 4;
+    typedef __m128i Px;
+    struct U16 { __m128i lo, hi; };
+
+    static inline Px load(const GPixel* src) { return _mm_loadu_si128((const __m128i*)src); }
+    static inline void store(GPixel* dst, Px p) { _mm_storeu_si128((__m128i*)dst, p); }
+    static inline Px splat(GPixel p) { return _mm_set1_epi32(p); }
+
+    static inline U16 widen(Px p) {
+        return { _mm_unpacklo_epi8(p, _mm_setzero_si128()), _mm_unpackhi_epi8(p, _mm_setzero_si128()) };
+    }
+    static inline Px narrow(U16 v) { return _mm_packus_epi16(v.lo, v.hi); }
+
+    static inline U16 add(U16 a, U16 b) { return { _mm_add_epi16(a.lo, b.lo), _mm_add_epi16(a.hi, b.hi) }; }
+    static inline U16 mul(U16 a, U16 b) { return { _mm_mullo_epi16(a.lo, b.lo), _mm_mullo_epi16(a.hi, b.hi) }; }
+    static inline U16 inv(U16 a) {
+        const __m128i k255 = _mm_set1_epi16(255);
+        return { _mm_sub_epi16(k255, a.lo), _mm_sub_epi16(k255, a.hi) };
+    }
+    static inline U16 zero() { return { _mm_setzero_si128(), _mm_setzero_si128() }; }
+
+    // Copies each pixel's alpha lane into its other three lanes.
+    static inline __m128i alpha(__m128i v) { return _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xFF), 0xFF); }
+    static inline U16 alpha(U16 a) { return { alpha(a.lo), alpha(a.hi) }; }
+
+    // ((x + 128) * 257) >> 16 == (x + 128 + ((x + 128) >> 8)) >> 8, which stays within 16 bits.
+    static inline __m128i div255(__m128i x) {
+        x = _mm_add_epi16(x, _mm_set1_epi16(128));
+        return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+    }
+    static inline U16 div255(U16 a) { return { div255(a.lo), div255(a.hi) }; }
+
+    #include "BlendSpan.inc"
+}
+#endif
+
+#if defined(G_SIMD_AVX2)
+G_BEGIN_AVX2
+// 8 pixels per block, held as two registers of 16-bit lanes.
+namespace avx2 {
+    const int N = 8;
+    typedef __m256i Px;
+    struct U16 { __m256i lo, hi; };
+
+    static inline Px load(const GPixel* src) { return _mm256_loadu_si256((const __m256i*)src); }
+    static inline void store(GPixel* dst, Px p) { _mm256_storeu_si256((__m256i*)dst, p); }
+    static inline Px splat(GPixel p) { return _mm256_set1_epi32(p); }
+
+    // Unpack and pack both work within 128-bit halves, so pixel order is preserved.
+    static inline U16 widen(Px p) {
+        return { _mm256_unpacklo_epi8(p, _mm256_setzero_si256()), _mm256_unpackhi_epi8(p, _mm256_setzero_si256()) };
+    }
+    static inline Px narrow(U16 v) { return _mm256_packus_epi16(v.lo, v.hi); }
+
+    static inline U16 add(U16 a, U16 b) { return { _mm256_add_epi16(a.lo, b.lo), _mm256_add_epi16(a.hi, b.hi) }; }
+    static inline U16 mul(U16 a, U16 b) { return { _mm256_mullo_epi16(a.lo, b.lo), _mm256_mullo_epi16(a.hi, b.hi) }; }
+    static inline U16 inv(U16 a) {
+        const __m256i k255 = _mm256_set1_epi16(255);
+        return { _mm256_sub_epi16(k255, a.lo), _mm256_sub_epi16(k255, a.hi) };
+    }
+    static inline U16 zero() { return { _mm256_setzero_si256(), _mm256_setzero_si256() }; }
+
+    static inline __m256i alpha(__m256i v) { return _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(v, 0xFF), 0xFF); }
+    static inline U16 alpha(U16 a) { return { alpha(a.lo), alpha(a.hi) }; }
+
+    static inline __m256i div255(__m256i x) {
+        x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+        return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+    }
+    static inline U16 div255(U16 a) { return { div255(a.lo), div255(a.hi) }; }
+
+    #include "BlendSpan.inc"
+}
+G_END_AVX2
+#endif
+
+// Blend mode reductions, indexed by [GBlendMode][SrcAlpha].
+static const GBlendMode reductions[][3] = {
+    //  kZero_SrcAlpha        kOpaque_SrcAlpha      kPartial_SrcAlpha
+    { GBlendMode::kClear, GBlendMode::kClear,   GBlendMode::kClear   },  // kClear
+    { GBlendMode::kClear, GBlendMode::kSrc,     GBlendMode::kSrc     },  // kSrc
+    { GBlendMode::kDst,   GBlendMode::kDst,     GBlendMode::kDst     },  // kDst
+    { GBlendMode::kDst,   GBlendMode::kSrc,     GBlendMode::kSrcOver },  // kSrcOver
+    { GBlendMode::kDst,   GBlendMode::kDstOver, GBlendMode::kDstOver },  // kDstOver
+    { GBlendMode::kClear, GBlendMode::kSrcIn,   GBlendMode::kSrcIn   },  // kSrcIn
+    { GBlendMode::kClear, GBlendMode::kDst,     GBlendMode::kDstIn   },  // kDstIn
+    { GBlendMode::kClear, GBlendMode::kSrcOut,  GBlendMode::kSrcOut  },  // kSrcOut
+    { GBlendMode::kDst,   GBlendMode::kClear,   GBlendMode::kDstOut  },  // kDstOut
+    { GBlendMode::kDst,   GBlendMode::kSrcIn,   GBlendMode::kSrcATop },  // kSrcATop
+    { GBlendMode::kClear, GBlendMode::kDstOver, GBlendMode::kDstATop },  // kDstATop
+    { GBlendMode::kDst,   GBlendMode::kSrcOut,  GBlendMode::kXor     },  // kXor
+};
+
+GBlendMode reduce_blend_mode(GBlendMode blend_mode, SrcAlpha src_alpha) {
+    return reductions[(int)blend_mode][src_alpha];
+}
+
+// Modes that never read dst.
+static void row_clear(GPixel dst[], const GPixel[], int count) { memset(dst, 0, count * sizeof(GPixel)); }
+static void row_src(GPixel dst[], const GPixel src[], int count) { memcpy(dst, src, count * sizeof(GPixel)); }
+static void row_dst(GPixel[], const GPixel[], int) {}
+
+static void color_clear(GPixel dst[], GPixel, int count) { memset(dst, 0, count * sizeof(GPixel)); }
+static void color_src(GPixel dst[], GPixel src, int count) { std::fill(dst, dst + count, src); }
+static void color_dst(GPixel[], GPixel, int) {}
+
+/**
+ * Returns the span blender for the reduced [blend_mode], using the widest instruction set available.
+ */
+blend_row_proc get_blend_row(GBlendMode blend_mode, SrcAlpha src_alpha) {
+    blend_mode = reduce_blend_mode(blend_mode, src_alpha);
+    switch (blend_mode) {
+        case GBlendMode::kClear: return row_clear;
+        case GBlendMode::kSrc:   return row_src;
+        case GBlendMode::kDst:   return row_dst;
+        default: break;
+    }
+#if defined(G_SIMD_AVX2)
+    if (cpu_has_avx2()) return avx2::row_procs[(int)blend_mode];
+#endif
+#if defined(G_SIMD_SSE2)
+    return sse2::row_procs[(int)blend_mode];
+#else
+    return scalar::row_procs[(int)blend_mode];
+#endif
+}
+
+/**
+ * Returns the solid color blender for the reduced [blend_mode], using the widest instruction set available.
+ */
+blend_color_proc get_blend_color(GBlendMode blend_mode, GPixel src) {
+    return get_blend_color(blend_mode, get_src_alpha(src));
+}
+
+blend_color_proc get_blend_color(GBlendMode blend_mode, SrcAlpha src_alpha) {
+    blend_mode = reduce_blend_mode(blend_mode, src_alpha);
+    switch (blend_mode) {
+        case GBlendMode::kClear: return color_clear;
+        case GBlendMode::kSrc:   return color_src;
+        case GBlendMode::kDst:   return color_dst;
+        default: break;
+    }
+#if defined(G_SIMD_AVX2)
+    if (cpu_has_avx2()) return avx2::color_procs[(int)blend_mode];
+#endif
+#if defined(G_SIMD_SSE2)
+    return sse2::color_procs[(int)blend_mode];
+#else
+    return scalar::color_procs[(int)blend_mode];
+#endif
+}
@@ -2,36 +2,55 @@
 #include <GMatrix.h>
 #include <GBitmap.h>
 #include <GColor.h>
-
-float mirror(float x);
-float repeat(float x);
+#include <ColorConvert.h>
+#include <Lowp.h>
+#include <Simd.h>
+#include <algorithm>
+#include <vector>
 
 class CanvasGradient : public GShader {
     public:
 
-    // Constructor.
-    CanvasGradient(GPoint p0, GPoint p1, const GColor _colors[], int _count, GShader::TileMode mode = GShader::kClamp) : n(_count), tile_mode(mode) {
+    enum Kind {
+        kLinear_Kind,   // position is x in gradient space.
+        kRadial_Kind,   // position is the distance from the origin in gradient space.
+        kSweep_Kind,    // position is the angle around the origin in gradient space, in turns.
+        kConical_Kind,  // position is the largest t whose circle, between two given ones, passes
+                        // through the point.
+    };
+
+    // Constructor. [matrix] maps gradient space, where the positions are measured, to local space.
+    CanvasGradient(Kind _kind, const GMatrix& matrix, const GColor _colors[], int _count, GShader::TileMode mode = GShader::kClamp)
+        : n(_count), kind(_kind), local_matrix(matrix), tile_mode(mode) {
         // Copying the given colors into the local color array.
-        colors = new GColor[_count];
+        colors.assign(_colors, _colors + _count);
+
+        // The same colors in 1.15 fixed point, with the last one repeated so that
+        // [index + 1] is always valid.
+        lowp_colors.resize(n + 1);
         for (int i = 0; i < n; i++) {
-            colors[i] = _colors[i];
+            lowp_colors[i] = to_lowp(colors[i]);
         }
+        lowp_colors[n] = lowp_colors[n - 1];
+    }
 
-        // Finding dx and dy.
-        float dx = p1.fX - p0.fX;
-        float dy = p1.fY - p0.fY;
-        
-        // Creating the local matrix: R*S*T.
-        local_matrix = {
-            dx, -dy, p0.fX,
-            dy,  dx, p0.fY
-        };
+    /**
+     *  Sets up a kConical_Kind gradient. In gradient space the circle at t is centered on
+     *  (t*d, 0) with radius r0 + t*dr, so t = 0 is the start circle and t = 1 the end circle.
+     */
+    void setConical(float d, float r0, float dr) {
+        conical_d = d;
+        conical_r0 = r0;
+        conical_dr = dr;
+        conical_a = d * d - dr * dr;
     }
 
     // Return true iff all of the GPixels that may be returned by this shader will be opaque.
     bool isOpaque() override {
+        // Unless one circle is inside the other, some points are on no circle and stay clear.
+        if (kind == kConical_Kind && !(conical_a < 0)) return false;
         for (int i = 0; i < n; i++) {
-            if (!(colors + i)->fA) {
+            if (colors[i].fA < 1) {
                 return false;
             }
         }
@@ -39,18 +58,56 @@ class CanvasGradient : public GShader {
     }
 
     // The draw calls in GCanvas must call this with the CTM before any calls to shadeRow().
+    // Caches everything shadeRow() needs for the rest of the draw.
     // Returns true if the matrix invertible and false if it's not.
     bool setContext(const GMatrix& new_ctm) {
         // Finding the determinant.
         float det = new_ctm[0] * new_ctm[4] - new_ctm[1] * new_ctm[3];
+        if (det == 0) return false;
+
+        // One table entry per device pixel from position 0 to 1, within [kMinLut, kMaxLut].
+        // A sweep's length depends on the radius, so it always gets the largest table.
+        // The table only depends on its size and precision, so it is rebuilt when those change.
+        GMatrix matrix = new_ctm * local_matrix;
+        float length = std::max(sqrtf(matrix[0] * matrix[0] + matrix[3] * matrix[3]),
+                                sqrtf(matrix[1] * matrix[1] + matrix[4] * matrix[4]));
+        if (kind == kSweep_Kind || kind == kConical_Kind) length = kMaxLut;
+        int size = kMinLut;
+        while (size < length && size < kMaxLut) {
+            size *= 2;
+        }
+        if (size != lut_size || use_lowp != lut_lowp) {
+            lut_size = size;
+            lut_lowp = use_lowp;
+            build_lut();
+        }
+        return updateContext(new_ctm);
+    }
+
+    // Maps the draw's table through a new CTM; only the inverse and the orientation change.
+    bool updateContext(const GMatrix& new_ctm) override {
+        float det = new_ctm[0] * new_ctm[4] - new_ctm[1] * new_ctm[3];
+        if (det == 0) return false;
+
+        // Device space --> gradient space, where the positions go from 0 to 1.
+        if (!(new_ctm * local_matrix).invert(&inverse_matrix)) return false;
 
-        // Setting a new ctm or just returning false.
-        if (det != 0) {
-            ctm = new_ctm;
-            return true;
+        // Classifying the direction the colors change in, in device space.
+        if (kind != kLinear_Kind) {
+            orientation = kAngled_Orientation;
+        } else if (inverse_matrix[0] == 0) {
+            orientation = kVertical_Orientation;
+        } else if (inverse_matrix[1] == 0) {
+            orientation = kHorizontal_Orientation;
         } else {
-            return false;
+            orientation = kAngled_Orientation;
         }
+        return true;
+    }
+
+    // Lowp interpolation is only used when the kernels exist on this target.
+    void setPrecision(Precision precision) override {
+        use_lowp = precision == kLowp_Precision && lowp_supported();
     }
 
     /**
@@ -59,45 +116,359 @@ class CanvasGradient : public GShader {
      *  can hold at least [count] entries.
      */
     void shadeRow(int x, int y, int count, GPixel row[]) override {
-        // Invariant fixes.
-        GMatrix inverse_matrix = ctm * local_matrix;
-        inverse_matrix.invert(&inverse_matrix);
+        shade(x, y, count, row);
+    }
+
+    // Every pixel in a row has the same color when the gradient runs vertically.
+    bool isRowConstant() override {
+        return orientation == kVertical_Orientation;
+    }
 
-        // Iterating values.
-        float fx = x + 0.5f;
-        float fy = y + 0.5f;
+    // Every row is the same when the gradient runs horizontally.
+    bool isColumnConstant() override {
+        return orientation == kHorizontal_Orientation;
+    }
+
+    // Shades the span from the table.
+    void shade(int x, int y, int count, GPixel row[]) const {
+        // Positions are looked up in the table in batches.
+        float position[kBatch];
+        bool valid[kBatch];
+
+        for (int start = 0; start < count; start += kBatch) {
+            int batch = std::min(kBatch, count - start);
+            bool all_valid = positions(x + start, y, batch, position, valid);
+            lut_to_pixels(row + start, lut, lut_size, position, batch);
+            if (!all_valid) clear_invalid(row + start, valid, batch);
+        }
+    }
 
-        // Iterate through the row.
+    // Pixels on no circle of a conical gradient are transparent.
+    static void clear_invalid(GPixel row[], const bool valid[], int count) {
         for (int i = 0; i < count; i++) {
-            // Finding the new point.
-            GPoint P = inverse_matrix * GPoint::Make(fx, fy);
-
-            // Mirror/repeat.
-            if (tile_mode == kMirror) {
-                P.set(mirror(P.fX), y);
-            } else if (tile_mode == kRepeat) {
-                P.set(repeat(P.fX), y);
+            if (!valid[i]) row[i] = 0;
+        }
+    }
+
+    /**
+     *  Bakes the gradient into [lut_size] premul pixels, evenly spaced from p0 to p1.
+     *  In lowp the colors are interpolated in 1.15 fixed point.
+     */
+    void build_lut() {
+        GColor batch[kBatch];
+        int index[kBatch];
+        int16_t weight[kBatch];
+
+        for (int start = 0; start < lut_size; start += kBatch) {
+            int count = std::min(kBatch, lut_size - start);
+
+            // Calculating the stop and the weight towards the next one.
+            for (int i = 0; i < count; i++) {
+                float t = (float)(start + i) / (lut_size - 1) * (n - 1);
+                int stop = std::min((int)t, std::max(n - 2, 0));
+                t -= stop;
+                if (use_lowp) {
+                    index[i] = stop;
+                    weight[i] = (int16_t)(t * 32767 + 0.5f);
+                } else {
+                    batch[i] = mixColors(1 - t, t, colors[stop], colors[std::min(stop + 1, n - 1)]);
+                }
             }
 
-            // Clamping.
-            if (P.fX >= 1) {
-                P.set(0.9999999, P.fY);
-            } else if (P.fX < 0) {
-                P.set(0.0000000, P.fY);
+            // Transforming the batch into premul pixels.
+            if (use_lowp) {
+                lowp_lerp_to_pixels(lut + start, lowp_colors.data(), index, weight, count);
+            } else {
+                colors_to_pixels(lut + start, batch, count);
+            }
+        }
+    }
+
+    /**
+     *  Writes the tiled positions, in [0, 1), of the [count] <= kBatch pixels starting at device
+     *  point (x, y). Returns false if some pixels have no position (valid[i] is then false);
+     *  otherwise valid[] is left alone.
+     */
+    bool positions(int x, int y, int count, float position[], bool valid[]) const {
+        bool all_valid = true;
+        switch (kind) {
+            case kLinear_Kind:
+                linear_positions(x, y, count, position);
+                return true;
+            case kRadial_Kind:
+                radial_positions(x, y, count, position);
+                break;
+            case kConical_Kind:
+                all_valid = conical_positions(x, y, count, position, valid);
+                break;
+            case kSweep_Kind:
+                sweep_positions(x, y, count, position);
+                break;
+        }
+        tile_positions(count, position);
+        return all_valid;
+    }
+
+    /**
+     *  Linear positions move at a constant rate along a row, so repeated and mirrored spans are
+     *  split into runs that stay inside one tile and need no floorf per pixel.
+     */
+    void linear_positions(int x, int y, int count, float position[]) const {
+        GPoint start = inverse_matrix * GPoint::Make(x + 0.5f, y + 0.5f);
+        float step = inverse_matrix[0];
+
+        int i = 0;
+        while (i < count) {
+            // The current tile is [tile_start, tile_start + 1); clamped spans are one run.
+            float u = start.fX + i * step;
+            float tile_start = 0;
+            bool reversed = false;
+            int run = count - i;
+            if (tile_mode != kClamp) {
+                tile_start = floorf(u);
+                reversed = tile_mode == kMirror && fmodf(tile_start, 2) != 0;
+
+                // Pixels until u leaves the tile.
+                float left = step > 0 ? ceilf((tile_start + 1 - u) / step) :
+                             step < 0 ? floorf((u - tile_start) / -step) + 1 : run;
+                run = std::max(1, (int)std::min(left, (float)run));
             }
 
-            // Calculating [t] and the new color.
-            float t = P.fX * (n - 1);
-            int index = int(t);
-            t -= index;
-            GColor color = mixColors(1 - t, t, colors[index], colors[index + 1]);
-            
-            // Transforming the color into a premul pixel and inserting it into [row].
-            GPixel colored_pixel = color_to_pixel(color);
-            row[i] = colored_pixel;
+            for (int end = i + run; i < end; i++) {
+                u = start.fX + i * step - tile_start;
+                if (reversed) u = 1 - u;
 
-            // Incrementing [fX].
-            fx += 1;
+                // Clamping.
+                if (u >= 1) {
+                    u = 0.9999999f;
+                } else if (u < 0) {
+                    u = 0;
+                }
+                position[i] = u;
+            }
+        }
+    }
+
+    /**
+     *  Writes the distance from the center, in gradient space, of the [count] pixels starting at
+     *  device point (x, y).
+     *
+     *  Along a row the squared distance is a quadratic in the pixel index i, C + B*i + A*i^2, so
+     *  it is stepped by forward differences and only the square root is taken per pixel. The
+     *  SSE2 loop steps 4 pixels at once: f(i + 4) - f(i) = 4B + A*(8i + 16), which grows by 32A.
+     */
+    void radial_positions(int x, int y, int count, float position[]) const {
+        GPoint start = inverse_matrix * GPoint::Make(x + 0.5f, y + 0.5f);
+        float vx = inverse_matrix[0];
+        float vy = inverse_matrix[3];
+        float A = vx * vx + vy * vy;
+        float B = 2 * (start.fX * vx + start.fY * vy);
+        float C = start.fX * start.fX + start.fY * start.fY;
+
+        int i = 0;
+#if defined(G_SIMD_SSE2)
+        const __m128 zero = _mm_setzero_ps();
+        __m128 j = _mm_setr_ps(0, 1, 2, 3);
+        __m128 f = _mm_add_ps(_mm_set1_ps(C), _mm_mul_ps(_mm_add_ps(_mm_set1_ps(B), _mm_mul_ps(_mm_set1_ps(A), j)), j));
+        __m128 d1 = _mm_add_ps(_mm_set1_ps(4 * B),
+                               _mm_mul_ps(_mm_set1_ps(A), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(8), j), _mm_set1_ps(16))));
+        __m128 d2 = _mm_set1_ps(32 * A);
+        for (; i + 4 <= count; i += 4) {
+            _mm_storeu_ps(position + i, _mm_sqrt_ps(_mm_max_ps(f, zero)));
+            f = _mm_add_ps(f, d1);
+            d1 = _mm_add_ps(d1, d2);
+        }
+#endif
+        float f1 = C + (B + A * i) * i;
+        float d11 = B + A * (2 * i + 1);
+        for (; i < count; i++) {
+            position[i] = sqrtf(std::max(f1, 0.0f));
+            f1 += d11;
+            d11 += 2 * A;
+        }
+    }
+
+    /**
+     *  Writes the t of the [count] pixels starting at device point (x, y), and whether they have
+     *  one. Returns false if some don't.
+     *
+     *  A point (x, y) in gradient space is on the circle at t when
+     *
+     *    a*t^2 - 2b*t + c = 0,  a = d^2 - dr^2,  b = x*d + r0*dr,  c = x^2 + y^2 - r0^2
+     *
+     *  Along a row b is linear and c quadratic in the pixel index, so both are stepped like
+     *  radial_positions() does. The roots are q/a and c/q with q = b +- sqrt(b^2 - a*c), the sign
+     *  following b's so that nothing cancels. The larger root whose radius r0 + t*dr is not
+     *  negative wins; points with neither have no t.
+     */
+    bool conical_positions(int x, int y, int count, float position[], bool valid[]) const {
+        GPoint start = inverse_matrix * GPoint::Make(x + 0.5f, y + 0.5f);
+        float vx = inverse_matrix[0];
+        float vy = inverse_matrix[3];
+        float a = conical_a;
+        float r0 = conical_r0;
+        float dr = conical_dr;
+
+        // b = b0 + db*i, c = C + B*i + A*i^2.
+        float b0 = start.fX * conical_d + r0 * dr;
+        float db = vx * conical_d;
+        float A = vx * vx + vy * vy;
+        float B = 2 * (start.fX * vx + start.fY * vy);
+        float C = start.fX * start.fX + start.fY * start.fY - r0 * r0;
+
+        bool all_valid = true;
+        int i = 0;
+#if defined(G_SIMD_SSE2)
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 sign = _mm_set1_ps(-0.0f);
+        const __m128 va = _mm_set1_ps(a);
+        const __m128 vr0 = _mm_set1_ps(r0);
+        const __m128 vdr = _mm_set1_ps(dr);
+        const __m128 has_t1 = a != 0 ? _mm_castsi128_ps(_mm_set1_epi32(-1)) : zero;
+        __m128 j = _mm_setr_ps(0, 1, 2, 3);
+        __m128 b = _mm_add_ps(_mm_set1_ps(b0), _mm_mul_ps(_mm_set1_ps(db), j));
+        __m128 db4 = _mm_set1_ps(4 * db);
+        __m128 c = _mm_add_ps(_mm_set1_ps(C), _mm_mul_ps(_mm_add_ps(_mm_set1_ps(B), _mm_mul_ps(_mm_set1_ps(A), j)), j));
+        __m128 d1 = _mm_add_ps(_mm_set1_ps(4 * B),
+                               _mm_mul_ps(_mm_set1_ps(A), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(8), j), _mm_set1_ps(16))));
+        __m128 d2 = _mm_set1_ps(32 * A);
+        for (; i + 4 <= count; i += 4) {
+            __m128 disc = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(va, c));
+            __m128 root = _mm_sqrt_ps(_mm_max_ps(disc, zero));
+            __m128 q = _mm_add_ps(b, _mm_or_ps(root, _mm_and_ps(sign, b)));
+            __m128 t1 = _mm_div_ps(q, va);
+            __m128 t2 = _mm_div_ps(c, q);
+
+            // The larger root if its radius is not negative, else the smaller one. Comparisons
+            // with NaN (q = 0) are false, so those lanes have no t.
+            __m128 ok1 = _mm_and_ps(has_t1, _mm_cmpge_ps(_mm_add_ps(vr0, _mm_mul_ps(t1, vdr)), zero));
+            __m128 ok2 = _mm_cmpge_ps(_mm_add_ps(vr0, _mm_mul_ps(t2, vdr)), zero);
+            __m128 first = _mm_and_ps(ok1, _mm_or_ps(_mm_cmpge_ps(t1, t2), _mm_andnot_ps(ok2, ok1)));
+            __m128 t = _mm_or_ps(_mm_and_ps(first, t1), _mm_andnot_ps(first, t2));
+            __m128 ok = _mm_and_ps(_mm_cmpge_ps(disc, zero), _mm_or_ps(ok1, ok2));
+            _mm_storeu_ps(position + i, _mm_and_ps(ok, t));
+
+            // valid[] is only written from the first pixel without a t on.
+            int mask = _mm_movemask_ps(ok);
+            if (mask != 0xF && all_valid) {
+                all_valid = false;
+                std::fill(valid, valid + i, true);
+            }
+            for (int k = 0; !all_valid && k < 4; k++) {
+                valid[i + k] = mask & (1 << k);
+            }
+
+            b = _mm_add_ps(b, db4);
+            c = _mm_add_ps(c, d1);
+            d1 = _mm_add_ps(d1, d2);
+        }
+#endif
+        float b1 = b0 + db * i;
+        float c1 = C + (B + A * i) * i;
+        float d11 = B + A * (2 * i + 1);
+        for (; i < count; i++) {
+            float disc = b1 * b1 - a * c1;
+            float q = b1 + copysignf(sqrtf(std::max(disc, 0.0f)), b1);
+            float t1 = q / a;
+            float t2 = c1 / q;
+            bool ok1 = a != 0 && r0 + t1 * dr >= 0;
+            bool ok2 = r0 + t2 * dr >= 0;
+            bool ok = disc >= 0 && (ok1 || ok2);
+            position[i] = !ok ? 0 : ok1 && (t1 >= t2 || !ok2) ? t1 : t2;
+            if (!ok && all_valid) {
+                all_valid = false;
+                std::fill(valid, valid + i, true);
+            }
+            if (!all_valid) valid[i] = ok;
+
+            b1 += db;
+            c1 += d11;
+            d11 += 2 * A;
+        }
+        return all_valid;
+    }
+
+    /**
+     *  Writes the angle around the center, in turns from the positive x axis, of the [count]
+     *  pixels starting at device point (x, y). Along a row, gradient space coordinates step by
+     *  the matrix's x column. atan2 is approximated by a polynomial on [0, 1] (within 2e-4
+     *  radians, well under one table entry), then moved into the right octant.
+     */
+    void sweep_positions(int x0, int y0, int count, float position[]) const {
+        const float kPi = 3.14159265f;
+        const float kC1 = 0.15931422f, kC2 = -0.327622764f, kC3 = -0.0464964749f;
+        GPoint start = inverse_matrix * GPoint::Make(x0 + 0.5f, y0 + 0.5f);
+        float vx = inverse_matrix[0];
+        float vy = inverse_matrix[3];
+
+        int i = 0;
+#if defined(G_SIMD_SSE2)
+        const __m128 sign = _mm_set1_ps(-0.0f);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 j = _mm_setr_ps(0, 1, 2, 3);
+        for (; i + 4 <= count; i += 4) {
+            __m128 index = _mm_add_ps(_mm_set1_ps((float)i), j);
+            __m128 x = _mm_add_ps(_mm_set1_ps(start.fX), _mm_mul_ps(index, _mm_set1_ps(vx)));
+            __m128 y = _mm_add_ps(_mm_set1_ps(start.fY), _mm_mul_ps(index, _mm_set1_ps(vy)));
+            __m128 ax = _mm_andnot_ps(sign, x);
+            __m128 ay = _mm_andnot_ps(sign, y);
+
+            // a = min/max in [0, 1] and its arctangent.
+            __m128 a = _mm_div_ps(_mm_min_ps(ax, ay), _mm_max_ps(_mm_max_ps(ax, ay), _mm_set1_ps(1e-30f)));
+            __m128 s = _mm_mul_ps(a, a);
+            __m128 r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(kC3), s), _mm_set1_ps(kC1));
+            r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(kC2));
+            r = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(r, s), a), a);
+
+            // Octant fix-ups: r = pi/2 - r, r = pi - r, r = -r.
+            __m128 swap = _mm_cmpgt_ps(ay, ax);
+            r = _mm_or_ps(_mm_and_ps(swap, _mm_sub_ps(_mm_set1_ps(kPi / 2), r)), _mm_andnot_ps(swap, r));
+            __m128 left = _mm_cmplt_ps(x, zero);
+            r = _mm_or_ps(_mm_and_ps(left, _mm_sub_ps(_mm_set1_ps(kPi), r)), _mm_andnot_ps(left, r));
+            __m128 up = _mm_cmplt_ps(y, zero);
+            r = _mm_or_ps(_mm_and_ps(up, _mm_sub_ps(_mm_set1_ps(2 * kPi), r)), _mm_andnot_ps(up, r));
+
+            _mm_storeu_ps(position + i, _mm_mul_ps(r, _mm_set1_ps(1 / (2 * kPi))));
+        }
+#endif
+        for (; i < count; i++) {
+            float px = start.fX + i * vx;
+            float py = start.fY + i * vy;
+            float ax = fabsf(px);
+            float ay = fabsf(py);
+
+            float a = std::min(ax, ay) / std::max(std::max(ax, ay), 1e-30f);
+            float s = a * a;
+            float r = ((kC3 * s + kC1) * s + kC2) * s * a + a;
+
+            if (ay > ax) r = kPi / 2 - r;
+            if (px < 0) r = kPi - r;
+            if (py < 0) r = 2 * kPi - r;
+            position[i] = r * (1 / (2 * kPi));
+        }
+    }
+
+    /**
+     *  Moves positions into [0, 1) according to the tile mode, one pixel at a time.
+     */
+    void tile_positions(int count, float position[]) const {
+        for (int i = 0; i < count; i++) {
+            float u = position[i];
+            if (tile_mode == kRepeat) {
+                u -= floorf(u);
+            } else if (tile_mode == kMirror) {
+                float tile_start = floorf(u);
+                u -= tile_start;
+                if (fmodf(tile_start, 2) != 0) u = 1 - u;
+            }
+
+            // Clamping.
+            if (u >= 1) {
+                u = 0.9999999f;
+            } else if (u < 0) {
+                u = 0;
+            }
+            position[i] = u;
         }
     }
 
@@ -111,39 +482,41 @@ class CanvasGradient : public GShader {
         );
     }
 
-    // Takes a color and transforms it into a premul pixel.
-    GPixel color_to_pixel(GColor color) {
-        return GPixel_PackARGB(
-            color.fA * 255 + 0.5,
-            color.fA * color.fR * 255 + 0.5,
-            color.fA * color.fG * 255 + 0.5,
-            color.fA * color.fB * 255 + 0.5
-        );
-    }
-
     private:
+        // Pixels per batch; positions() is never asked for more.
+        static constexpr int kBatch = 64;
+
+        enum Orientation {
+            kVertical_Orientation,      // colors only change with y.
+            kHorizontal_Orientation,    // colors only change with x.
+            kAngled_Orientation,        // colors change with both.
+        };
+
         const int n;
-        GColor* colors;
-        GMatrix ctm;
+        Kind kind;
+        std::vector<GColor> colors;
+        std::vector<LowpColor> lowp_colors;
+        bool use_lowp = false;
         GMatrix local_matrix;
-        GShader::TileMode tile_mode;
-};
 
-float mirror(float x) {
-    x -= floorf(x);
-    x -= floorf(x);
-    if (GRoundToInt(x) % 2) {
-        return 1 - x;
-    } else {
-        return x;
-    }
-}
+        // The circles of a conical gradient; see setConical().
+        float conical_d = 0;
+        float conical_r0 = 0;
+        float conical_dr = 0;
+        float conical_a = 0;
 
-float repeat(float x) {
-    x -= floorf(x);
-    x -= floorf(x);
-    return x;
-}
+        // The gradient baked into premul pixels by setContext().
+        static constexpr int kMinLut = 256;
+        static constexpr int kMaxLut = 1024;
+        GPixel lut[kMaxLut];
+        int lut_size = 0;
+        bool lut_lowp = false;
+
+        Orientation orientation;
+
+        GMatrix inverse_matrix;
+        GShader::TileMode tile_mode;
+};
 
 /**
  *  Return a subclass of GShader that draws the specified gradient of [count] colors between
@@ -158,12 +531,70 @@ float repeat(float x) {
  *  If count < 1, this should return nullptr.
  */
 std::unique_ptr<GShader> GCreateLinearGradient(GPoint p0, GPoint p1, const GColor colors[], int count) {
+    return GCreateLinearGradient(p0, p1, colors, count, GShader::kClamp);
+}
+
+std::unique_ptr<GShader> GCreateLinearGradient(GPoint p0, GPoint p1, const GColor colors[], int count, GShader::TileMode tile_mode) {
     // Quick check.
     if (count < 1) return nullptr;
-    return std::unique_ptr<GShader>(new CanvasGradient(p0, p1, colors, count)); 
+
+    // Finding dx and dy.
+    float dx = p1.fX - p0.fX;
+    float dy = p1.fY - p0.fY;
+
+    // Creating the local matrix: R*S*T.
+    GMatrix matrix = {
+        dx, -dy, p0.fX,
+        dy,  dx, p0.fY
+    };
+    return std::unique_ptr<GShader>(new CanvasGradient(CanvasGradient::kLinear_Kind, matrix, colors, count, tile_mode));
 }
 
-std::unique_ptr<GShader> GCreateLinearGradient(GPoint p0, GPoint p1, const GColor colors[], int count, GShader::TileMode tile_mode) {
+/**
+ *  Return a subclass of GShader that draws a radial gradient of [count] colors from the center
+ *  out to the radius.
+ */
+std::unique_ptr<GShader> GCreateRadialGradient(GPoint center, float radius, const GColor colors[], int count, GShader::TileMode tile_mode) {
+    if (count < 1 || !(radius > 0)) return nullptr;
+
+    // The unit circle, scaled to the radius and moved to the center.
+    GMatrix matrix = {
+        radius, 0,      center.fX,
+        0,      radius, center.fY
+    };
+    return std::unique_ptr<GShader>(new CanvasGradient(CanvasGradient::kRadial_Kind, matrix, colors, count, tile_mode));
+}
+
+/**
+ *  Return a subclass of GShader that draws a sweep gradient of [count] colors around the center.
+ */
+std::unique_ptr<GShader> GCreateSweepGradient(GPoint center, const GColor colors[], int count, GShader::TileMode tile_mode) {
     if (count < 1) return nullptr;
-    return std::unique_ptr<GShader>(new CanvasGradient(p0, p1, colors, count, tile_mode));
-}
\ No newline at end of file
+    return std::unique_ptr<GShader>(new CanvasGradient(CanvasGradient::kSweep_Kind, GMatrix::Translate(center.fX, center.fY), colors, count, tile_mode));
+}
+/**
+ *  Return a subclass of GShader that draws a two-point conical gradient of [count] colors,
+ *  from the circle (c0, r0) to the circle (c1, r1).
+ */
+std::unique_ptr<GShader> GCreateTwoPointConicalGradient(GPoint c0, float r0, GPoint c1, float r1,
+                                                        const GColor colors[], int count, GShader::TileMode tile_mode) {
+    if (count < 1 || !(r0 >= 0) || !(r1 >= 0)) return nullptr;
+
+    // Gradient space puts c0 on the origin and c1 on the positive x axis, scaled so that the
+    // distance and the radii are at most 1.
+    float dx = c1.fX - c0.fX;
+    float dy = c1.fY - c0.fY;
+    float d = sqrtf(dx * dx + dy * dy);
+    float scale = std::max(d, std::max(r0, r1));
+    if (!(scale > 0) || (d == 0 && r0 == r1)) return nullptr;
+
+    float ux = d > 0 ? dx / d : 1;
+    float uy = d > 0 ? dy / d : 0;
+    GMatrix matrix = {
+        scale * ux, -scale * uy, c0.fX,
+        scale * uy,  scale * ux, c0.fY
+    };
+    CanvasGradient* gradient = new CanvasGradient(CanvasGradient::kConical_Kind, matrix, colors, count, tile_mode);
+    gradient->setConical(d / scale, r0 / scale, (r1 - r0) / scale);
+    return std::unique_ptr<GShader>(gradient);
+}
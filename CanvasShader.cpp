@@ -1,14 +1,69 @@
 #include <GShader.h>
 #include <GMatrix.h>
 #include <GBitmap.h>
+#include <GMath.h>
+#include <Simd.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if defined(G_SIMD_AVX2)
+G_BEGIN_AVX2
+namespace avx2 {
+    /**
+     *  Moves from a towards b by w / 256 on 16-bit channels, rounding. [a_high] holds a * 256 + 128,
+     *  which interleaving a's bytes above bytes of 0x80 gives in one unpack.
+     */
+    static inline __m256i lerp8(__m256i a, __m256i a_high, __m256i b, __m256i w) {
+        return _mm256_srli_epi16(_mm256_add_epi16(a_high, _mm256_mullo_epi16(_mm256_sub_epi16(b, a), w)), 8);
+    }
+
+    /**
+     *  CanvasShader::bilerp_translated() on 8 pixels at a time. Returns how many pixels it wrote.
+     *  Channels are spread over 16 bits per lane: lo holds columns i, i + 1, i + 4, i + 5 and
+     *  hi holds i + 2, i + 3, i + 6, i + 7.
+     */
+    static int bilerp_translated(GPixel row[], const GPixel top[], const GPixel bottom[], int wx, int wy, int count) {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i bias = _mm256_set1_epi8((char)0x80);
+        const __m256i wx16 = _mm256_set1_epi16(wx);
+        const __m256i wy16 = _mm256_set1_epi16(wy);
+
+        int i = 0;
+        if (count < 16) return i;
+        __m256i t = _mm256_loadu_si256((const __m256i*)top);
+        __m256i b = _mm256_loadu_si256((const __m256i*)bottom);
+        __m256i lo = lerp8(_mm256_unpacklo_epi8(t, zero), _mm256_unpacklo_epi8(bias, t), _mm256_unpacklo_epi8(b, zero), wy16);
+        __m256i hi = lerp8(_mm256_unpackhi_epi8(t, zero), _mm256_unpackhi_epi8(bias, t), _mm256_unpackhi_epi8(b, zero), wy16);
+        for (; i + 16 <= count + 1; i += 8) {
+            t = _mm256_loadu_si256((const __m256i*)(top + i + 8));
+            b = _mm256_loadu_si256((const __m256i*)(bottom + i + 8));
+            __m256i next_lo = lerp8(_mm256_unpacklo_epi8(t, zero), _mm256_unpacklo_epi8(bias, t), _mm256_unpacklo_epi8(b, zero), wy16);
+            __m256i next_hi = lerp8(_mm256_unpackhi_epi8(t, zero), _mm256_unpackhi_epi8(bias, t), _mm256_unpackhi_epi8(b, zero), wy16);
+
+            // Columns i + 1, i + 2, i + 5, i + 6 and i + 3, i + 4, i + 7, i + 8.
+            __m256i right_lo = _mm256_alignr_epi8(hi, lo, 8);
+            __m256i right_hi = _mm256_alignr_epi8(_mm256_permute2x128_si256(lo, next_lo, 0x21), hi, 8);
+            const __m256i half = _mm256_set1_epi16(128);
+            __m256i out_lo = lerp8(lo, _mm256_or_si256(_mm256_slli_epi16(lo, 8), half), right_lo, wx16);
+            __m256i out_hi = lerp8(hi, _mm256_or_si256(_mm256_slli_epi16(hi, 8), half), right_hi, wx16);
+            _mm256_storeu_si256((__m256i*)(row + i), _mm256_packus_epi16(out_lo, out_hi));
+            lo = next_lo;
+            hi = next_hi;
+        }
+        return i;
+    }
+}
+G_END_AVX2
+#endif
 
 class CanvasShader : public GShader {
     public:
 
     // Constructor.
-    CanvasShader(const GBitmap& device, const GMatrix& matrix, GShader::TileMode mode = GShader::kClamp) : bit_map(device), local_matrix(matrix), tile_mode(mode) {
-        inverse_width  = (float) 1 / bit_map.width();
-        inverse_height = (float) 1 / bit_map.height();
+    CanvasShader(const GBitmap& device, const GMatrix& matrix, GShader::TileMode mode = GShader::kClamp,
+                 GShader::FilterQuality quality = GShader::kNearest_FilterQuality)
+        : bit_map(device), local_matrix(matrix), tile_mode(mode), filter_quality(quality), texture(device) {
     };
 
     // Return true iff all of the GPixels that may be returned by this shader will be opaque.
@@ -17,93 +72,858 @@ class CanvasShader : public GShader {
     }
 
     // The draw calls in GCanvas must call this with the CTM before any calls to shadeRow().
+    // Caches everything shadeRow() needs for the rest of the draw. Meshes call it again (through
+    // updateContext()) for each triangle, which picks its own mip level; the pyramid and the
+    // swizzled copies are only made once.
     // Returns true if the matrix invertible and false if it's not.
     bool setContext(const GMatrix& new_ctm) {
         // Finding and checking the determinant.
         float det = new_ctm[0] * new_ctm[4] - new_ctm[1] * new_ctm[3];
         if (det == 0) return false;
 
-        // Setting the new ctm.
-        ctm = new_ctm;
+        // Device space --> bitmap space.
+        if (!(new_ctm * local_matrix).invert(&inverse_matrix)) return false;
+
+        // Minified draws sample the mip level with about one texel per pixel, so neighbouring
+        // pixels read neighbouring texels. The pyramid is built on the first minified draw.
+        level = mip_level(inverse_matrix);
+        if (level > 0 && mips.empty()) build_mips();
+        level = std::min(level, (int)mips.size());
+        texture = level > 0 ? mips[level - 1].bitmap : bit_map;
+        if (level > 0) {
+            // Bitmap space --> level space.
+            inverse_matrix = GMatrix::Scale((float)texture.width() / bit_map.width(),
+                                            (float)texture.height() / bit_map.height()) * inverse_matrix;
+        }
+
+        // Classifying the matrix, so shadeRow() only steps the coordinates that change.
+        if (inverse_matrix[1] == 0 && inverse_matrix[3] == 0) {
+            matrix_class = inverse_matrix[0] == 1 && inverse_matrix[4] == 1 ? kTranslate_MatrixClass : kScaleTranslate_MatrixClass;
+        } else {
+            matrix_class = kAffine_MatrixClass;
+        }
+
+        // Rotated and skewed spans walk across bitmap rows, so large textures are sampled from a
+        // copy stored in 4x4 squares, which keeps the texels a span touches in fewer cache lines.
+        bool swizzle = matrix_class == kAffine_MatrixClass &&
+                       (int64_t)texture.width() * texture.height() >= kMinSwizzledTexels;
+        if (swizzle) {
+            if ((int)swizzled.size() <= level) swizzled.resize(level + 1);
+            if (swizzled[level].empty()) build_swizzled(texture, &swizzled[level]);
+            layout = kSwizzled_Layout;
+            texels = swizzled[level].data();
+            row_stride = 16 * ((texture.width() + 3) / 4);
+        } else {
+            layout = kRowMajor_Layout;
+            texels = texture.pixels();
+            row_stride = (int)(texture.rowBytes() >> 2);
+        }
+
+        // Stepping one pixel to the right in device space moves by the matrix's x column.
+        step_x = to_fixed(inverse_matrix[0]);
+        step_y = to_fixed(inverse_matrix[3]);
+
+        // Pixel centers that land on texel centers have nothing to filter.
+        bool texel_aligned = matrix_class == kTranslate_MatrixClass &&
+                             inverse_matrix[2] == floorf(inverse_matrix[2]) &&
+                             inverse_matrix[5] == floorf(inverse_matrix[5]);
+        bilinear = filter_quality == kBilinear_FilterQuality && !texel_aligned;
         return true;
     }
 
+    // The pyramid and the swizzled copies are made from the old pixels; the next draws that
+    // need them make them again.
+    void notifyPixelsChanged() override {
+        mips.clear();
+        swizzled.clear();
+    }
+
     /**
      *  Given a row of pixels in device space [x, y] ... [x + count - 1, y], return the
      *  corresponding src pixels in row[0...count - 1]. The caller must ensure that row[]
      *  can hold at least [count] entries.
      */
     void shadeRow(int x, int y, int count, GPixel row[]) override {
-        // Invariant fixing.
-        GMatrix inverse_matrix = ctm * local_matrix;
-        inverse_matrix.invert(&inverse_matrix);
-        float fx = x + 0.5f;
-        float fy = y + 0.5f;
-
-        // Iterate through the row.
-        for (int i = 0; i < count; i++) {
-            // Finding the new point.
-            GPoint P = inverse_matrix * GPoint::Make(fx, fy);
-            
-            // Repeating tiles.
-            if (tile_mode == kRepeat) {
-                P.set(repeat(P.x(), inverse_width, bit_map.width()), repeat(P.y(), inverse_height, bit_map.height()));
-
-            // Mirroring tiles.
-            } else if (tile_mode == kMirror) {
-                P.set(mirror(P.x(), inverse_width, bit_map.width()), mirror(P.y(), inverse_height, bit_map.height()));
-            }
-            
-            // Clamping 
-            P.set(pin(P.x(), 0, bit_map.width() - 1), pin(P.y(), 0, bit_map.height() - 1));
-            
-            // Assign the new pixel to an index in row.
-            row[i] = *bit_map.getAddr(GFloorToInt(P.x()), GFloorToInt(P.y()));
-
-            // Incrementing.
-            fx += 1;
+        if (bilinear) {
+            switch (tile_mode) {
+                case kClamp:  shadeRowBilinear<kClamp>(x, y, count, row);  break;
+                case kRepeat: shadeRowBilinear<kRepeat>(x, y, count, row); break;
+                case kMirror: shadeRowBilinear<kMirror>(x, y, count, row); break;
+            }
+            return;
+        }
+        switch (tile_mode) {
+            case kClamp:  shadeRow<kClamp>(x, y, count, row);  break;
+            case kRepeat: shadeRow<kRepeat>(x, y, count, row); break;
+            case kMirror: shadeRow<kMirror>(x, y, count, row); break;
         }
     }
 
-    // Takes a value and pins it to the appropriate border.
-    float pin(float value, int min, int max) {
-        if (value > max) {
-            return max;
-        } else if (value < min) {
-            return min;
-        } else {
-            return value;
+    private:
+        // A level of the mip pyramid and the pixels it owns.
+        struct MipLevel {
+            std::vector<GPixel> pixels;
+            GBitmap bitmap;
+        };
+
+        /**
+         *  Returns the mip level for a device --> bitmap matrix: level L halves the bitmap L
+         *  times and is picked once a device pixel spans 2^L texels along either axis.
+         */
+        static int mip_level(const GMatrix& inverse) {
+            float texels = std::max(sqrtf(inverse[0] * inverse[0] + inverse[3] * inverse[3]),
+                                    sqrtf(inverse[1] * inverse[1] + inverse[4] * inverse[4]));
+            int level = 0;
+            while (texels >= 2 && level < 30) {
+                texels *= 0.5f;
+                level++;
+            }
+            return level;
         }
-    }
 
-    float repeat(float coord, float inverse_dimension, float dimension) {
-        coord *= inverse_dimension;
-        coord -= floorf(coord);
-        coord -= floorf(coord);
-        coord *= dimension;
-        return coord;
-    }
+        /**
+         *  Halves the bitmap until it is one texel in both directions. Odd dimensions round up,
+         *  and the last texel of a level then averages with itself.
+         */
+        void build_mips() {
+            GBitmap src = bit_map;
+            while (src.width() > 1 || src.height() > 1) {
+                int width = (src.width() + 1) / 2;
+                int height = (src.height() + 1) / 2;
 
-    float mirror(float coord, float inverse_dimension, float dimension) {
-        coord *= inverse_dimension;
-        if ((int)(coord) % 2) {
-            coord -= floorf(coord);
-            coord -= floorf(coord);
-            coord = 1 - coord;
-        } else {
-            coord -= floorf(coord);
-            coord -= floorf(coord);
+                // Moving a level keeps its pixels where they are, so its bitmap stays valid.
+                mips.emplace_back();
+                MipLevel& mip = mips.back();
+                mip.pixels.resize((size_t)width * height);
+                mip.bitmap = GBitmap(width, height, width * sizeof(GPixel), mip.pixels.data(), false);
+                downsample(src, mip.bitmap);
+                mip.bitmap.setIsOpaque(bit_map.isOpaque() ? GBitmap::kYes_IsOpaque : GBitmap::kNo_IsOpaque);
+                src = mip.bitmap;
+            }
+        }
+
+        /**
+         *  dst = src averaged over 2x2 blocks, rounding. Premul pixels stay premul.
+         */
+        static void downsample(const GBitmap& src, const GBitmap& dst) {
+            for (int y = 0; y < dst.height(); y++) {
+                const GPixel* row0 = src.getAddr(0, 2 * y);
+                const GPixel* row1 = src.getAddr(0, std::min(2 * y + 1, src.height() - 1));
+                GPixel* out = dst.getAddr(0, y);
+
+                int x = 0;
+#if defined(G_SIMD_SSE2)
+                // Two output pixels from four texels of each row.
+                const __m128i zero = _mm_setzero_si128();
+                const __m128i two = _mm_set1_epi16(2);
+                for (; 2 * x + 4 <= src.width(); x += 2) {
+                    __m128i top = _mm_loadu_si128((const __m128i*)(row0 + 2 * x));
+                    __m128i bottom = _mm_loadu_si128((const __m128i*)(row1 + 2 * x));
+                    __m128i sum01 = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+                    __m128i sum23 = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+                    __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(sum01, sum23), _mm_unpackhi_epi64(sum01, sum23));
+                    sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+                    _mm_storel_epi64((__m128i*)(out + x), _mm_packus_epi16(sum, sum));
+                }
+#endif
+                for (; x < dst.width(); x++) {
+                    int x0 = 2 * x;
+                    int x1 = std::min(2 * x + 1, src.width() - 1);
+                    GPixel result = 0;
+                    for (int shift = 0; shift < 32; shift += 8) {
+                        int sum = ((row0[x0] >> shift) & 0xFF) + ((row0[x1] >> shift) & 0xFF) +
+                                  ((row1[x0] >> shift) & 0xFF) + ((row1[x1] >> shift) & 0xFF);
+                        result |= (GPixel)((sum + 2) >> 2) << shift;
+                    }
+                    out[x] = result;
+                }
+            }
+        }
+
+        enum Layout {
+            kRowMajor_Layout,   // the texture's own rows.
+            kSwizzled_Layout,   // 4x4 squares of texels, each one cache line, in row-major order.
+        };
+
+        // Textures this large (1MB) no longer fit in L2, so rotated spans miss on most fetches.
+        static constexpr int kMinSwizzledTexels = 512 * 512;
+
+        /**
+         *  Copies a texture into 4x4 squares. Its dimensions are padded to a multiple of 4; the
+         *  padding is never read.
+         */
+        static void build_swizzled(const GBitmap& src, std::vector<GPixel>* dst) {
+            int squares_per_row = (src.width() + 3) / 4;
+            int square_rows = (src.height() + 3) / 4;
+            dst->assign((size_t)squares_per_row * square_rows * 16, 0);
+            for (int y = 0; y < src.height(); y++) {
+                const GPixel* row = src.getAddr(0, y);
+                GPixel* out = dst->data() + (size_t)(y >> 2) * squares_per_row * 16 + ((y & 3) << 2);
+                int x = 0;
+                for (; x + 4 <= src.width(); x += 4) {
+                    memcpy(out + 4 * x, row + x, 4 * sizeof(GPixel));
+                }
+                memcpy(out + 4 * x, row + x, (src.width() - x) * sizeof(GPixel));
+            }
+        }
+
+        /**
+         *  A texel is at texels[row_offset(y) + column_offset(x)]. Row-major textures step rows by
+         *  the stride. Swizzled ones step squares by 16 texels and square rows by row_stride.
+         */
+        int row_offset(int y) const {
+            return layout == kRowMajor_Layout ? y * row_stride : (y >> 2) * row_stride + ((y & 3) << 2);
+        }
+        int column_offset(int x) const {
+            return layout == kRowMajor_Layout ? x : ((x >> 2) << 4) + (x & 3);
+        }
+        GPixel fetch(int x, int y) const {
+            return texels[row_offset(y) + column_offset(x)];
+        }
+
+        enum MatrixClass {
+            kTranslate_MatrixClass,         // only translates.
+            kScaleTranslate_MatrixClass,    // scales and translates; y is constant along a row.
+            kAffine_MatrixClass,            // anything else.
+        };
+
+        // Sample points filtered per batch.
+        static constexpr int kBatch = 64;
+
+        // The largest bitmap coordinate 16.16 fixed point holds.
+        static constexpr float kMaxFixed = 32767;
+
+        // Converts a bitmap coordinate to 16.16 fixed point.
+        static int32_t to_fixed(float coord) {
+            return (int32_t)floorf(coord * 65536 + 0.5f);
+        }
+
+        /**
+         *  Maps an integer texel coordinate onto [0, dimension) according to the tile mode.
+         *  Mirroring reflects around every tile edge, so a period spans two tiles. Power of two
+         *  dimensions wrap with a mask instead of a modulo.
+         */
+        template <TileMode M> static int tile(int coord, int dimension) {
+            bool pow2 = (dimension & (dimension - 1)) == 0;
+            switch (M) {
+                case kClamp:
+                    return std::min(std::max(coord, 0), dimension - 1);
+                case kRepeat:
+                    if (pow2) return coord & (dimension - 1);
+                    coord %= dimension;
+                    return coord < 0 ? coord + dimension : coord;
+                case kMirror:
+                    if (pow2) {
+                        coord &= 2 * dimension - 1;
+                        return coord & dimension ? ~coord & (dimension - 1) : coord;
+                    }
+                    coord %= 2 * dimension;
+                    if (coord < 0) coord += 2 * dimension;
+                    return coord < dimension ? coord : 2 * dimension - 1 - coord;
+            }
+            return 0;
+        }
+
+        /**
+         *  Returns how far an integer texel coordinate is into its tile, in [0, dimension).
+         *  Sets [reversed] if that tile is mirrored, i.e. its texels are read right to left.
+         */
+        template <TileMode M> static int tile_offset(int coord, int dimension, bool* reversed) {
+            int offset = tile<kRepeat>(coord, dimension);
+            *reversed = M == kMirror && tile<kRepeat>(coord, 2 * dimension) >= dimension;
+            return offset;
+        }
+
+        /**
+         *  Moves a float coordinate close to the bitmap without changing the texels it tiles to,
+         *  so that it fits in an int (or in 16.16 fixed point, for bitmaps under 16K texels).
+         */
+        template <TileMode M> static float wrap(float coord, int dimension) {
+            if (M == kClamp) {
+                return std::min(std::max(coord, -1.0f), (float)dimension);
+            }
+            float period = 2.0f * dimension;
+            return coord - floorf(coord / period) * period;
+        }
+
+        /**
+         *  Same as tile(), for a float coordinate that may not fit in an int.
+         */
+        template <TileMode M> static int tile(float coord, int dimension) {
+            return tile<M>(GFloorToInt(wrap<M>(coord, dimension)), dimension);
+        }
+
+        /**
+         *  Copies texels [ix, ix + count) of a bitmap row into row[], repeating the edge texels
+         *  outside [0, width).
+         */
+        static void copy_clamped(GPixel row[], const GPixel src[], int ix, int count, int width) {
+            int left = std::min(std::max(-ix, 0), count);
+            int middle = std::min(std::max(width - std::max(ix, 0), 0), count - left);
+            std::fill(row, row + left, src[0]);
+            // src + ix + left is only inside the row when there is something to copy.
+            if (middle > 0) memcpy(row + left, src + ix + left, middle * sizeof(GPixel));
+            std::fill(row + left + middle, row + count, src[width - 1]);
+        }
+
+        /**
+         *  Copies texels [ix, ix + count) of a repeated or mirrored bitmap row into row[], one
+         *  run per tile.
+         */
+        template <TileMode M> static void copy_tiled(GPixel row[], const GPixel src[], int ix, int count, int width) {
+            while (count > 0) {
+                bool reversed;
+                int offset = tile_offset<M>(ix, width, &reversed);
+                int n = std::min(width - offset, count);
+                if (reversed) {
+                    const GPixel* texel = src + width - 1 - offset;
+                    for (int i = 0; i < n; i++) {
+                        row[i] = texel[-i];
+                    }
+                } else {
+                    memcpy(row, src + offset, n * sizeof(GPixel));
+                }
+                row += n;
+                ix += n;
+                count -= n;
+            }
+        }
+
+        /**
+         *  Fetches [count] texels of a repeated or mirrored bitmap row, starting at 16.16 [fx]
+         *  and stepping by [step_x]. The span is split into runs that stay inside one tile, so
+         *  each run is a plain (or reversed) fetch.
+         */
+        template <TileMode M> void fetch_tiled(GPixel row[], const GPixel src[], int32_t fx, int count, int width) {
+            const int64_t tile_end = (int64_t)width << 16;
+            while (count > 0) {
+                bool reversed;
+                int64_t local = ((int64_t)tile_offset<M>(fx >> 16, width, &reversed) << 16) | (fx & 0xFFFF);
+
+                // Pixels until the coordinate leaves [0, tile_end).
+                int64_t n = count;
+                if (step_x > 0) {
+                    n = std::min(n, (tile_end - local + step_x - 1) / step_x);
+                } else if (step_x < 0) {
+                    n = std::min(n, local / -step_x + 1);
+                }
+
+                for (int i = 0; i < n; i++) {
+                    int texel = (int)(local >> 16);
+                    row[i] = src[reversed ? width - 1 - texel : texel];
+                    local += step_x;
+                }
+                row += n;
+                fx += (int32_t)n * step_x;
+                count -= (int)n;
+            }
+        }
+
+        template <TileMode M> void shadeRow(int x, int y, int count, GPixel row[]) {
+            const int width = texture.width();
+            const int height = texture.height();
+
+            // The span's first and last points in bitmap space.
+            GPoint start = inverse_matrix * GPoint::Make(x + 0.5f, y + 0.5f);
+            GPoint end = inverse_matrix * GPoint::Make(x + count - 0.5f, y + 0.5f);
+
+            // Coordinates too far out for 16.16 fixed point are mapped per pixel in float.
+            if (std::max(std::max(fabsf(start.x()), fabsf(start.y())), std::max(fabsf(end.x()), fabsf(end.y()))) >= kMaxFixed) {
+                for (int i = 0; i < count; i++) {
+                    GPoint P = inverse_matrix * GPoint::Make(x + i + 0.5f, y + 0.5f);
+                    row[i] = fetch(tile<M>(P.x(), width), tile<M>(P.y(), height));
+                }
+                return;
+            }
+
+            int32_t fx = to_fixed(start.x());
+            int32_t fy = to_fixed(start.y());
+
+            switch (matrix_class) {
+                // Whole texels, one per pixel, all on the same bitmap row.
+                case kTranslate_MatrixClass: {
+                    const GPixel* src = texture.getAddr(0, tile<M>(fy >> 16, height));
+                    int ix = fx >> 16;
+                    if (M == kClamp) {
+                        copy_clamped(row, src, ix, count, width);
+                    } else {
+                        copy_tiled<M>(row, src, ix, count, width);
+                    }
+                    break;
+                }
+
+                // Stepping x only, all on the same bitmap row.
+                case kScaleTranslate_MatrixClass: {
+                    const GPixel* src = texture.getAddr(0, tile<M>(fy >> 16, height));
+                    if (M != kClamp) {
+                        fetch_tiled<M>(row, src, fx, count, width);
+                        break;
+                    }
+                    for (int i = 0; i < count; i++) {
+                        row[i] = src[tile<M>(fx >> 16, width)];
+                        fx += step_x;
+                    }
+                    break;
+                }
+
+                // Stepping both coordinates.
+                case kAffine_MatrixClass: {
+                    for (int i = 0; i < count; i++) {
+                        row[i] = fetch(tile<M>(fx >> 16, width), tile<M>(fy >> 16, height));
+                        fx += step_x;
+                        fy += step_y;
+                    }
+                    break;
+                }
+            }
+        }
+
+        /**
+         *  Bilinear filtering. Sample points are 16.16 texel coordinates measured from the
+         *  texel centers, i.e. half a texel left of and above the bitmap coordinate. The integer
+         *  parts pick the 2x2 block of texels (each tiled like a nearest sample), and the top 8
+         *  bits of the fractions weigh them.
+         */
+        template <TileMode M> void shadeRowBilinear(int x, int y, int count, GPixel row[]) const {
+            const int width = texture.width();
+            const int height = texture.height();
+            int32_t u[kBatch], v[kBatch];
+
+            GPoint start = inverse_matrix * GPoint::Make(x + 0.5f, y + 0.5f);
+            GPoint end = inverse_matrix * GPoint::Make(x + count - 0.5f, y + 0.5f);
+            bool fits = std::max(std::max(fabsf(start.x()), fabsf(start.y())), std::max(fabsf(end.x()), fabsf(end.y()))) < kMaxFixed;
+            int32_t fu = fits ? to_fixed(start.x()) - 0x8000 : 0;
+            int32_t fv = fits ? to_fixed(start.y()) - 0x8000 : 0;
+
+            // Translated spans weigh every block the same, so they blend texels straight out of
+            // the two bitmap rows.
+            // Narrow repeated bitmaps cross a seam every few texels, which the batches handle better.
+            if (fits && matrix_class == kTranslate_MatrixClass && (M == kClamp || width >= kBatch)) {
+                shadeRowBilinearTranslated<M>(fu, fv, count, row);
+                return;
+            }
+
+            // Spans on one pair of bitmap rows lerp the rows once per texel column.
+            if (fits && matrix_class != kAffine_MatrixClass && std::abs(step_x) < (2 << 16)) {
+                shadeRowBilinearRows<M>(fu, fv, count, row);
+                return;
+            }
+
+            for (int i = 0; i < count; i += kBatch) {
+                int n = std::min(kBatch, count - i);
+                if (fits) {
+                    // Stepping both coordinates, the same way nearest sampling does.
+                    for (int k = 0; k < n; k++) {
+                        u[k] = fu;
+                        v[k] = fv;
+                        fu += step_x;
+                        fv += step_y;
+                    }
+                } else {
+                    // Coordinates too far out for 16.16 fixed point are wrapped per pixel in float.
+                    for (int k = 0; k < n; k++) {
+                        GPoint P = inverse_matrix * GPoint::Make(x + i + k + 0.5f, y + 0.5f);
+                        u[k] = to_fixed(wrap<M>(P.x(), width) - 0.5f);
+                        v[k] = to_fixed(wrap<M>(P.y(), height) - 0.5f);
+                    }
+                }
+                bilerp<M>(row + i, u, v, n);
+            }
+        }
+
+        // Texel columns a batch of scaled sample points can touch, while they step by under 2.
+        static constexpr int kColumns = 2 * kBatch + 2;
+
+        /**
+         *  Bilinear filtering for spans that stay on one pair of bitmap rows, i.e. scaled or
+         *  translated bitmaps. Each batch first lerps the two rows by the constant wy over the
+         *  columns it touches, then each pixel lerps two neighbouring columns by its wx. That
+         *  is two texel loads per pixel instead of four, and gives the same pixels as bilerp().
+         */
+        template <TileMode M> void shadeRowBilinearRows(int32_t fu, int32_t fv, int count, GPixel row[]) const {
+            const int width = texture.width();
+            const int height = texture.height();
+            const GPixel* top = texels + tile<M>(fv >> 16, height) * row_stride;
+            const GPixel* bottom = texels + tile<M>((fv >> 16) + 1, height) * row_stride;
+            const int wy = (fv >> 8) & 0xFF;
+
+            GPixel columns[kColumns];
+            for (int i = 0; i < count; i += kBatch) {
+                int n = std::min(kBatch, count - i);
+                int32_t last = fu + (n - 1) * step_x;
+                int first_column = std::min(fu, last) >> 16;
+                int column_count = (std::max(fu, last) >> 16) - first_column + 2;
+                assert(column_count <= kColumns);
+                lerp_rows<M>(columns, top, bottom, first_column, column_count, width, wy);
+
+                // Sample points relative to the first column.
+                int32_t u = fu - first_column * 65536;
+                if (step_x == 1 << 16) {
+                    // Translated bitmaps weigh every pair of columns the same.
+                    lerp_texels(row + i, columns + (u >> 16), columns + (u >> 16) + 1, (u >> 8) & 0xFF, n);
+                } else {
+                    lerp_columns(row + i, columns, u, step_x, n);
+                }
+                fu += n * step_x;
+            }
+        }
+
+        /**
+         *  Bilinear filtering for translated bitmaps. wx and wy are the same for the whole draw,
+         *  so each run of texels inside the bitmap is blended in one pass over its two rows, with
+         *  no stepping or tiling per pixel. Runs past a clamped edge and mirrored tiles take
+         *  shadeRowBilinearRows(); the pixel on a tile seam is blended on its own.
+         */
+        template <TileMode M> void shadeRowBilinearTranslated(int32_t fu, int32_t fv, int count, GPixel row[]) const {
+            const int width = texture.width();
+            const int height = texture.height();
+            const GPixel* top = texels + tile<M>(fv >> 16, height) * row_stride;
+            const GPixel* bottom = texels + tile<M>((fv >> 16) + 1, height) * row_stride;
+            const int wx = (fu >> 8) & 0xFF;
+            const int wy = (fv >> 8) & 0xFF;
+
+            for (int i = 0; i < count;) {
+                bool reversed = false;
+                int column = M == kClamp ? (fu >> 16) + i : tile_offset<M>((fu >> 16) + i, width, &reversed);
+                int n;
+                if (!reversed && column >= 0 && column + 1 < width) {
+                    // Both columns of every block are inside the bitmap.
+                    n = std::min(count - i, width - 1 - column);
+                    bilerp_translated(row + i, top + column, bottom + column, wx, wy, n);
+                } else if (M != kClamp && !reversed) {
+                    // A seam: the right column is the first one of the next tile.
+                    int right = tile<M>((fu >> 16) + i + 1, width);
+                    row[i] = bilerp_block(top[column], top[right], bottom[column], bottom[right], wx, wy);
+                    n = 1;
+                } else {
+                    n = M == kClamp ? (column < 0 ? std::min(count - i, -column) : count - i)
+                                    : std::min(count - i, width - column);
+                    shadeRowBilinearRows<M>(fu + i * 65536, fv, n, row + i);
+                }
+                i += n;
+            }
+        }
+
+        /**
+         *  columns[k] = the lerp of the top and bottom texels of tiled column [first + k] by wy,
+         *  for [count] columns. The columns are split into runs that stay inside one tile (or
+         *  past one clamped edge), so each run lerps texels in place.
+         */
+        template <TileMode M> static void lerp_rows(GPixel columns[], const GPixel top[], const GPixel bottom[],
+                                                    int first, int count, int width, int wy) {
+            while (count > 0) {
+                int n;
+                if (M == kClamp && (first < 0 || first >= width)) {
+                    // Past an edge, every column is the edge column.
+                    int edge = first < 0 ? 0 : width - 1;
+                    n = first < 0 ? std::min(count, -first) : count;
+                    std::fill(columns, columns + n, lerp_pixel(top[edge], bottom[edge], wy));
+                } else {
+                    bool reversed = false;
+                    int column = M == kClamp ? first : tile_offset<M>(first, width, &reversed);
+                    n = std::min(count, width - column);
+                    if (reversed) {
+                        // A mirrored tile reads the same texels backwards.
+                        int start = width - column - n;
+                        lerp_texels(columns, top + start, bottom + start, wy, n);
+                        std::reverse(columns, columns + n);
+                    } else {
+                        lerp_texels(columns, top + column, bottom + column, wy, n);
+                    }
+                }
+                columns += n;
+                first += n;
+                count -= n;
+            }
+        }
+
+        // The 2x2 texel blocks of a batch of sample points, as offsets from the first texel.
+        struct Blocks {
+            int32_t p00[kBatch];    // top left.
+            int32_t p10[kBatch];    // top right.
+            int32_t p01[kBatch];    // bottom left.
+            int32_t p11[kBatch];    // bottom right.
+            int32_t wx[kBatch];
+            int32_t wy[kBatch];
+        };
+
+#if defined(G_SIMD_SSE2)
+        /**
+         *  tile() on four integer coordinates. Repeat and mirror are only masks here, so they
+         *  need power of two dimensions.
+         */
+        template <TileMode M> static __m128i tile(__m128i coord, int dimension) {
+            const __m128i last = _mm_set1_epi32(dimension - 1);
+            switch (M) {
+                case kClamp: {
+                    coord = _mm_andnot_si128(_mm_srai_epi32(coord, 31), coord);
+                    __m128i over = _mm_cmpgt_epi32(coord, last);
+                    return _mm_or_si128(_mm_and_si128(over, last), _mm_andnot_si128(over, coord));
+                }
+                case kRepeat:
+                    return _mm_and_si128(coord, last);
+                case kMirror: {
+                    const __m128i d = _mm_set1_epi32(dimension);
+                    coord = _mm_and_si128(coord, _mm_set1_epi32(2 * dimension - 1));
+                    __m128i reversed = _mm_cmpeq_epi32(_mm_and_si128(coord, d), d);
+                    return _mm_and_si128(_mm_xor_si128(coord, reversed), last);
+                }
+            }
+            return coord;
+        }
+
+        // row_offset() and column_offset() on four coordinates; rows must fit in 16 bits.
+        __m128i row_offsets(__m128i y) const {
+            const __m128i stride = _mm_set1_epi32(row_stride);
+            if (layout == kRowMajor_Layout) return _mm_madd_epi16(y, stride);
+            return _mm_add_epi32(_mm_madd_epi16(_mm_srai_epi32(y, 2), stride),
+                                 _mm_slli_epi32(_mm_and_si128(y, _mm_set1_epi32(3)), 2));
+        }
+        __m128i column_offsets(__m128i x) const {
+            if (layout == kRowMajor_Layout) return x;
+            const __m128i three = _mm_set1_epi32(3);
+            return _mm_add_epi32(_mm_slli_epi32(_mm_andnot_si128(three, x), 2), _mm_and_si128(x, three));
+        }
+#endif
+
+        /**
+         *  Splits sample points into their blocks' tiled columns and rows, and their weights.
+         *  Four points are split at a time when the tiling is a clamp or a mask.
+         */
+        template <TileMode M> void locate_blocks(const int32_t u[], const int32_t v[], int count, Blocks* blocks) const {
+            const int width = texture.width();
+            const int height = texture.height();
+
+            int i = 0;
+#if defined(G_SIMD_SSE2)
+            bool pow2 = (width & (width - 1)) == 0 && (height & (height - 1)) == 0;
+            // Rows are multiplied by the stride with 16-bit multiplies.
+            if ((M == kClamp || pow2) && row_stride < 32768 && height < 32768) {
+                const __m128i one = _mm_set1_epi32(1);
+                const __m128i mask = _mm_set1_epi32(0xFF);
+                for (; i + 4 <= count; i += 4) {
+                    __m128i fu = _mm_loadu_si128((const __m128i*)(u + i));
+                    __m128i fv = _mm_loadu_si128((const __m128i*)(v + i));
+                    __m128i x = _mm_srai_epi32(fu, 16);
+                    __m128i y = _mm_srai_epi32(fv, 16);
+                    __m128i left = column_offsets(tile<M>(x, width));
+                    __m128i right = column_offsets(tile<M>(_mm_add_epi32(x, one), width));
+                    __m128i top = row_offsets(tile<M>(y, height));
+                    __m128i bottom = row_offsets(tile<M>(_mm_add_epi32(y, one), height));
+                    _mm_storeu_si128((__m128i*)(blocks->p00 + i), _mm_add_epi32(top, left));
+                    _mm_storeu_si128((__m128i*)(blocks->p10 + i), _mm_add_epi32(top, right));
+                    _mm_storeu_si128((__m128i*)(blocks->p01 + i), _mm_add_epi32(bottom, left));
+                    _mm_storeu_si128((__m128i*)(blocks->p11 + i), _mm_add_epi32(bottom, right));
+                    _mm_storeu_si128((__m128i*)(blocks->wx + i), _mm_and_si128(_mm_srai_epi32(fu, 8), mask));
+                    _mm_storeu_si128((__m128i*)(blocks->wy + i), _mm_and_si128(_mm_srai_epi32(fv, 8), mask));
+                }
+            }
+#endif
+            for (; i < count; i++) {
+                int left = column_offset(tile<M>(u[i] >> 16, width));
+                int right = column_offset(tile<M>((u[i] >> 16) + 1, width));
+                int top = row_offset(tile<M>(v[i] >> 16, height));
+                int bottom = row_offset(tile<M>((v[i] >> 16) + 1, height));
+                blocks->p00[i] = top + left;
+                blocks->p10[i] = top + right;
+                blocks->p01[i] = bottom + left;
+                blocks->p11[i] = bottom + right;
+                blocks->wx[i] = (u[i] >> 8) & 0xFF;
+                blocks->wy[i] = (v[i] >> 8) & 0xFF;
+            }
+        }
+
+        // Moves from a towards b by w / 256, rounding.
+        static int lerp8(int a, int b, int w) {
+            return (a * (256 - w) + b * w + 128) >> 8;
+        }
+
+        // lerp8() on each channel of two pixels.
+        static GPixel lerp_pixel(GPixel a, GPixel b, int w) {
+            GPixel result = 0;
+            for (int shift = 0; shift < 32; shift += 8) {
+                result |= (GPixel)lerp8((a >> shift) & 0xFF, (b >> shift) & 0xFF, w) << shift;
+            }
+            return result;
+        }
+
+        // Lerps the left and right pairs of texels by wy, then the results by wx.
+        static GPixel bilerp_block(GPixel p00, GPixel p10, GPixel p01, GPixel p11, int wx, int wy) {
+            return lerp_pixel(lerp_pixel(p00, p01, wy), lerp_pixel(p10, p11, wy), wx);
+        }
+
+#if defined(G_SIMD_SSE2)
+        // Spreads four 32-bit weights over the 16-bit channels of pixels 0, 1 (lo) and 2, 3 (hi).
+        static void spread_weights(__m128i w, __m128i* lo, __m128i* hi) {
+            w = _mm_or_si128(w, _mm_slli_epi32(w, 16));
+            *lo = _mm_shuffle_epi32(w, _MM_SHUFFLE(1, 1, 0, 0));
+            *hi = _mm_shuffle_epi32(w, _MM_SHUFFLE(3, 3, 2, 2));
+        }
+
+        // lerp8() on 16-bit channels, as a * 256 + (b - a) * w + 128. The sum fits in 16 unsigned
+        // bits, so the wrapping 16-bit math gives it exactly.
+        static __m128i lerp8(__m128i a, __m128i b, __m128i w) {
+            __m128i sum = _mm_add_epi16(_mm_slli_epi16(a, 8), _mm_mullo_epi16(_mm_sub_epi16(b, a), w));
+            return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(128)), 8);
+        }
+
+        // lerp_pixel() on four pairs of pixels, each with its own weight.
+        static __m128i lerp_pixels(__m128i a, __m128i b, __m128i w) {
+            const __m128i zero = _mm_setzero_si128();
+            __m128i w_lo, w_hi;
+            spread_weights(w, &w_lo, &w_hi);
+            return _mm_packus_epi16(lerp8(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), w_lo),
+                                    lerp8(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), w_hi));
+        }
+
+        // Loads the four texels at src[offset[0...3]].
+        static __m128i gather(const GPixel src[], const int32_t offset[4]) {
+            return _mm_setr_epi32(src[offset[0]], src[offset[1]], src[offset[2]], src[offset[3]]);
+        }
+
+        // bilerp_block() on four blocks at once; gives the exact same pixels.
+        static __m128i bilerp_blocks(__m128i p00, __m128i p10, __m128i p01, __m128i p11, __m128i wx, __m128i wy) {
+            return lerp_pixels(lerp_pixels(p00, p01, wy), lerp_pixels(p10, p11, wy), wx);
+        }
+#endif
+
+        /**
+         *  row[i] = bilerp_block(top[i], top[i + 1], bottom[i], bottom[i + 1], wx, wy), reading
+         *  texels [0, count] of both rows. Each column is lerped by wy once, and its right
+         *  neighbour is shifted in from the next column's register.
+         */
+        static void bilerp_translated(GPixel row[], const GPixel top[], const GPixel bottom[], int wx, int wy, int count) {
+            int i = 0;
+#if defined(G_SIMD_AVX2)
+            if (cpu_has_avx2()) i = avx2::bilerp_translated(row, top, bottom, wx, wy, count);
+#endif
+#if defined(G_SIMD_SSE2)
+            if (i + 8 <= count) {
+                const __m128i zero = _mm_setzero_si128();
+                const __m128i wx16 = _mm_set1_epi16(wx);
+                const __m128i wy16 = _mm_set1_epi16(wy);
+
+                // Columns i, i + 1 (lo) and i + 2, i + 3 (hi), lerped by wy, in 16-bit channels.
+                __m128i a = _mm_loadu_si128((const __m128i*)(top + i));
+                __m128i b = _mm_loadu_si128((const __m128i*)(bottom + i));
+                __m128i lo = lerp8(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), wy16);
+                __m128i hi = lerp8(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), wy16);
+                for (; i + 8 <= count + 1; i += 4) {
+                    a = _mm_loadu_si128((const __m128i*)(top + i + 4));
+                    b = _mm_loadu_si128((const __m128i*)(bottom + i + 4));
+                    __m128i next_lo = lerp8(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), wy16);
+                    __m128i next_hi = lerp8(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), wy16);
+
+                    // Columns i + 1, i + 2 and i + 3, i + 4.
+                    __m128i right_lo = _mm_or_si128(_mm_srli_si128(lo, 8), _mm_slli_si128(hi, 8));
+                    __m128i right_hi = _mm_or_si128(_mm_srli_si128(hi, 8), _mm_slli_si128(next_lo, 8));
+                    _mm_storeu_si128((__m128i*)(row + i),
+                                     _mm_packus_epi16(lerp8(lo, right_lo, wx16), lerp8(hi, right_hi, wx16)));
+                    lo = next_lo;
+                    hi = next_hi;
+                }
+            }
+#endif
+            for (; i < count; i++) {
+                row[i] = bilerp_block(top[i], top[i + 1], bottom[i], bottom[i + 1], wx, wy);
+            }
+        }
+
+        // dst[i] = lerp_pixel(top[i], bottom[i], w).
+        static void lerp_texels(GPixel dst[], const GPixel top[], const GPixel bottom[], int w, int count) {
+            int i = 0;
+#if defined(G_SIMD_SSE2)
+            const __m128i weight = _mm_set1_epi32(w);
+            for (; i + 4 <= count; i += 4) {
+                __m128i a = _mm_loadu_si128((const __m128i*)(top + i));
+                __m128i b = _mm_loadu_si128((const __m128i*)(bottom + i));
+                _mm_storeu_si128((__m128i*)(dst + i), lerp_pixels(a, b, weight));
+            }
+#endif
+            for (; i < count; i++) {
+                dst[i] = lerp_pixel(top[i], bottom[i], w);
+            }
+        }
+
+        /**
+         *  row[i] = lerp_pixel(columns[k], columns[k + 1], w) for the 16.16 point u + i * step,
+         *  where k is its integer part and w the top 8 bits of its fraction.
+         */
+        static void lerp_columns(GPixel row[], const GPixel columns[], int32_t u, int32_t step, int count) {
+            int i = 0;
+#if defined(G_SIMD_SSE2)
+            __m128i u4 = _mm_setr_epi32(u, u + step, u + 2 * step, u + 3 * step);
+            const __m128i step4 = _mm_set1_epi32(4 * step);
+            const __m128i mask = _mm_set1_epi32(0xFF);
+            for (; i + 4 <= count; i += 4) {
+                __m128i k = _mm_srai_epi32(u4, 16);
+                __m128i w = _mm_and_si128(_mm_srli_epi32(u4, 8), mask);
+
+                // Each load holds a pixel's left and right columns.
+                __m128i c0 = _mm_loadl_epi64((const __m128i*)(columns + _mm_cvtsi128_si32(k)));
+                __m128i c1 = _mm_loadl_epi64((const __m128i*)(columns + _mm_cvtsi128_si32(_mm_shuffle_epi32(k, 1))));
+                __m128i c2 = _mm_loadl_epi64((const __m128i*)(columns + _mm_cvtsi128_si32(_mm_shuffle_epi32(k, 2))));
+                __m128i c3 = _mm_loadl_epi64((const __m128i*)(columns + _mm_cvtsi128_si32(_mm_shuffle_epi32(k, 3))));
+                __m128i c01 = _mm_unpacklo_epi32(c0, c1);
+                __m128i c23 = _mm_unpacklo_epi32(c2, c3);
+                _mm_storeu_si128((__m128i*)(row + i),
+                                 lerp_pixels(_mm_unpacklo_epi64(c01, c23), _mm_unpackhi_epi64(c01, c23), w));
+                u4 = _mm_add_epi32(u4, step4);
+            }
+            u += i * step;
+#endif
+            for (; i < count; i++) {
+                row[i] = lerp_pixel(columns[u >> 16], columns[(u >> 16) + 1], (u >> 8) & 0xFF);
+                u += step;
+            }
+        }
+
+        // row[i] = the filtered texels around sample point (u[i], v[i]), for up to kBatch points.
+        template <TileMode M> void bilerp(GPixel row[], const int32_t u[], const int32_t v[], int count) const {
+            Blocks blocks;
+            locate_blocks<M>(u, v, count, &blocks);
+            const GPixel* src = texels;
+
+            int i = 0;
+#if defined(G_SIMD_SSE2)
+            for (; i + 4 <= count; i += 4) {
+                __m128i p00 = gather(src, blocks.p00 + i);
+                __m128i p10 = gather(src, blocks.p10 + i);
+                __m128i p01 = gather(src, blocks.p01 + i);
+                __m128i p11 = gather(src, blocks.p11 + i);
+                __m128i wx = _mm_loadu_si128((const __m128i*)(blocks.wx + i));
+                __m128i wy = _mm_loadu_si128((const __m128i*)(blocks.wy + i));
+                _mm_storeu_si128((__m128i*)(row + i), bilerp_blocks(p00, p10, p01, p11, wx, wy));
+            }
+#endif
+            for (; i < count; i++) {
+                row[i] = bilerp_block(src[blocks.p00[i]], src[blocks.p10[i]], src[blocks.p01[i]], src[blocks.p11[i]],
+                                      blocks.wx[i], blocks.wy[i]);
+            }
         }
-        return coord * dimension;
-    }
 
-    private:
         const GBitmap bit_map;
-        float inverse_width;
-        float inverse_height;
         GMatrix local_matrix;
         GShader::TileMode tile_mode;
-        GMatrix ctm;
+        GShader::FilterQuality filter_quality;
+        bool bilinear = false;
+
+        // The mip pyramid, from half size down to 1x1, and the bitmap (or level) the current
+        // context samples.
+        std::vector<MipLevel> mips;
+        int level = 0;
+        GBitmap texture;
+
+        // The texels the current context reads and their layout. Swizzled copies are kept per
+        // mip level (0 being the bitmap itself) and made on the first rotated draw that needs them.
+        std::vector<std::vector<GPixel>> swizzled;
+        Layout layout = kRowMajor_Layout;
+        const GPixel* texels = nullptr;
+        int row_stride = 0;
+        GMatrix inverse_matrix;
+        MatrixClass matrix_class;
+        int32_t step_x;
+        int32_t step_y;
 };
 
 /**
@@ -118,6 +938,7 @@ std::unique_ptr<GShader> GCreateBitmapShader(const GBitmap& bit_map, const GMatr
  *  Return a subclass of GShader that draws the specified bitmap and a local matrix.
  *  Returns null if the either parameter is invalid.
  */
-std::unique_ptr<GShader> GCreateBitmapShader(const GBitmap& bit_map, const GMatrix& localMatrix, GShader::TileMode tile_mode) {
-    return std::unique_ptr<GShader>(new CanvasShader(bit_map, localMatrix, tile_mode));
+std::unique_ptr<GShader> GCreateBitmapShader(const GBitmap& bit_map, const GMatrix& localMatrix, GShader::TileMode tile_mode,
+                                             GShader::FilterQuality quality) {
+    return std::unique_ptr<GShader>(new CanvasShader(bit_map, localMatrix, tile_mode, quality));
 }
\ No newline at end of file
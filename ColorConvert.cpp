@@ -0,0 +1,222 @@
+#include <ColorConvert.h>
+#include <Simd.h>
+
+/**
+ * Rounding note: color_to_pixel() computes x + 0.5 in double and truncates, i.e. floor(x + 0.5)
+ * with no rounding error. Adding 0.5f in float can round up just below a half, so the vector
+ * code truncates first and adds one when the dropped fraction is at least one half. Both the
+ * truncation and the subtraction are exact for 0 <= x < 2^23.
+ *
+ * Colors are pinned to [0, 1] before rounding, like color_to_pixel(), so components that stray
+ * out of range (e.g. ramps past a triangle's edge) saturate instead of spilling into the
+ * neighbouring bytes.
+ */
+
+#if defined(G_SIMD_SSE2)
+namespace sse2 {
+    static inline __m128i round(__m128 x) {
+        __m128i i = _mm_cvttps_epi32(x);
+        __m128 half = _mm_cmpge_ps(_mm_sub_ps(x, _mm_cvtepi32_ps(i)), _mm_set1_ps(0.5f));
+        return _mm_sub_epi32(i, _mm_castps_si128(half));   // true lanes are -1.
+    }
+
+    // Pins x to [0, 1]; NaNs become 0.
+    static inline __m128 pin(__m128 x) {
+        return _mm_min_ps(_mm_max_ps(x, _mm_setzero_ps()), _mm_set1_ps(1));
+    }
+
+    // Premultiplies and packs 4 pixels.
+    static inline __m128i pack(__m128 a, __m128 r, __m128 g, __m128 b) {
+        const __m128 k255 = _mm_set1_ps(255);
+        a = pin(a), r = pin(r), g = pin(g), b = pin(b);
+        __m128i A = round(_mm_mul_ps(a, k255));
+        __m128i R = round(_mm_mul_ps(_mm_mul_ps(a, r), k255));
+        __m128i G = round(_mm_mul_ps(_mm_mul_ps(a, g), k255));
+        __m128i B = round(_mm_mul_ps(_mm_mul_ps(a, b), k255));
+        return _mm_or_si128(_mm_or_si128(_mm_slli_epi32(A, GPIXEL_SHIFT_A), _mm_slli_epi32(R, GPIXEL_SHIFT_R)),
+                            _mm_or_si128(_mm_slli_epi32(G, GPIXEL_SHIFT_G), _mm_slli_epi32(B, GPIXEL_SHIFT_B)));
+    }
+
+    // Loads 4 GColors and transposes them into one register per component.
+    static inline void load_colors(const GColor src[], __m128* a, __m128* r, __m128* g, __m128* b) {
+        __m128 c0 = _mm_loadu_ps(&src[0].fA);
+        __m128 c1 = _mm_loadu_ps(&src[1].fA);
+        __m128 c2 = _mm_loadu_ps(&src[2].fA);
+        __m128 c3 = _mm_loadu_ps(&src[3].fA);
+        _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+        *a = c0, *r = c1, *g = c2, *b = c3;
+    }
+
+    static int colors_to_pixels(GPixel dst[], const GColor src[], int count) {
+        int i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m128 a, r, g, b;
+            load_colors(src + i, &a, &r, &g, &b);
+            _mm_storeu_si128((__m128i*)(dst + i), pack(a, r, g, b));
+        }
+        return i;
+    }
+
+    static int lanes_to_pixels(GPixel dst[], const float a[], const float r[], const float g[], const float b[], int count) {
+        int i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m128i p = pack(_mm_loadu_ps(a + i), _mm_loadu_ps(r + i), _mm_loadu_ps(g + i), _mm_loadu_ps(b + i));
+            _mm_storeu_si128((__m128i*)(dst + i), p);
+        }
+        return i;
+    }
+
+    // Continues a ramp from pixel [i].
+    static int ramp_to_pixels(GPixel dst[], const GColor& start, const GColor& delta, int i, int count) {
+        const __m128 lane = _mm_setr_ps(0, 1, 2, 3);
+        for (; i + 4 <= count; i += 4) {
+            __m128 steps = _mm_add_ps(_mm_set1_ps(i), lane);
+            __m128 a = _mm_add_ps(_mm_set1_ps(start.fA), _mm_mul_ps(steps, _mm_set1_ps(delta.fA)));
+            __m128 r = _mm_add_ps(_mm_set1_ps(start.fR), _mm_mul_ps(steps, _mm_set1_ps(delta.fR)));
+            __m128 g = _mm_add_ps(_mm_set1_ps(start.fG), _mm_mul_ps(steps, _mm_set1_ps(delta.fG)));
+            __m128 b = _mm_add_ps(_mm_set1_ps(start.fB), _mm_mul_ps(steps, _mm_set1_ps(delta.fB)));
+            _mm_storeu_si128((__m128i*)(dst + i), pack(a, r, g, b));
+        }
+        return i;
+    }
+}
+#endif
+
+#if defined(G_SIMD_AVX2)
+G_BEGIN_AVX2
+namespace avx2 {
+    static inline __m256i round(__m256 x) {
+        __m256i i = _mm256_cvttps_epi32(x);
+        __m256 half = _mm256_cmp_ps(_mm256_sub_ps(x, _mm256_cvtepi32_ps(i)), _mm256_set1_ps(0.5f), _CMP_GE_OQ);
+        return _mm256_sub_epi32(i, _mm256_castps_si256(half));
+    }
+
+    static inline __m256 pin(__m256 x) {
+        return _mm256_min_ps(_mm256_max_ps(x, _mm256_setzero_ps()), _mm256_set1_ps(1));
+    }
+
+    // Premultiplies and packs 8 pixels.
+    static inline __m256i pack(__m256 a, __m256 r, __m256 g, __m256 b) {
+        const __m256 k255 = _mm256_set1_ps(255);
+        a = pin(a), r = pin(r), g = pin(g), b = pin(b);
+        __m256i A = round(_mm256_mul_ps(a, k255));
+        __m256i R = round(_mm256_mul_ps(_mm256_mul_ps(a, r), k255));
+        __m256i G = round(_mm256_mul_ps(_mm256_mul_ps(a, g), k255));
+        __m256i B = round(_mm256_mul_ps(_mm256_mul_ps(a, b), k255));
+        return _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(A, GPIXEL_SHIFT_A), _mm256_slli_epi32(R, GPIXEL_SHIFT_R)),
+                               _mm256_or_si256(_mm256_slli_epi32(G, GPIXEL_SHIFT_G), _mm256_slli_epi32(B, GPIXEL_SHIFT_B)));
+    }
+
+    static int colors_to_pixels(GPixel dst[], const GColor src[], int count) {
+        int i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m128 a0, r0, g0, b0, a1, r1, g1, b1;
+            sse2::load_colors(src + i,     &a0, &r0, &g0, &b0);
+            sse2::load_colors(src + i + 4, &a1, &r1, &g1, &b1);
+            __m256i p = pack(_mm256_set_m128(a1, a0), _mm256_set_m128(r1, r0),
+                             _mm256_set_m128(g1, g0), _mm256_set_m128(b1, b0));
+            _mm256_storeu_si256((__m256i*)(dst + i), p);
+        }
+        return i;
+    }
+
+    static int lanes_to_pixels(GPixel dst[], const float a[], const float r[], const float g[], const float b[], int count) {
+        int i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256i p = pack(_mm256_loadu_ps(a + i), _mm256_loadu_ps(r + i), _mm256_loadu_ps(g + i), _mm256_loadu_ps(b + i));
+            _mm256_storeu_si256((__m256i*)(dst + i), p);
+        }
+        return i;
+    }
+
+    // Continues a ramp from pixel [i].
+    static int ramp_to_pixels(GPixel dst[], const GColor& start, const GColor& delta, int i, int count) {
+        const __m256 lane = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+        for (; i + 8 <= count; i += 8) {
+            __m256 steps = _mm256_add_ps(_mm256_set1_ps(i), lane);
+            __m256 a = _mm256_add_ps(_mm256_set1_ps(start.fA), _mm256_mul_ps(steps, _mm256_set1_ps(delta.fA)));
+            __m256 r = _mm256_add_ps(_mm256_set1_ps(start.fR), _mm256_mul_ps(steps, _mm256_set1_ps(delta.fR)));
+            __m256 g = _mm256_add_ps(_mm256_set1_ps(start.fG), _mm256_mul_ps(steps, _mm256_set1_ps(delta.fG)));
+            __m256 b = _mm256_add_ps(_mm256_set1_ps(start.fB), _mm256_mul_ps(steps, _mm256_set1_ps(delta.fB)));
+            _mm256_storeu_si256((__m256i*)(dst + i), pack(a, r, g, b));
+        }
+        return i;
+    }
+
+    static int lut_to_pixels(GPixel dst[], const GPixel lut[], int lut_size, const float position[], int count) {
+        const __m256 scale = _mm256_set1_ps(lut_size - 1);
+        const __m256 half = _mm256_set1_ps(0.5f);
+        int i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256i index = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(position + i), scale), half));
+            _mm256_storeu_si256((__m256i*)(dst + i), _mm256_i32gather_epi32((const int*)lut, index, 4));
+        }
+        return i;
+    }
+}
+G_END_AVX2
+#endif
+
+/**
+ * Transforms [count] unpremul colors into premul pixels.
+ */
+void colors_to_pixels(GPixel dst[], const GColor src[], int count) {
+    int i = 0;
+#if defined(G_SIMD_AVX2)
+    if (cpu_has_avx2()) i = avx2::colors_to_pixels(dst, src, count);
+#endif
+#if defined(G_SIMD_SSE2)
+    i += sse2::colors_to_pixels(dst + i, src + i, count - i);
+#endif
+    for (; i < count; i++) {
+        dst[i] = color_to_pixel(src[i]);
+    }
+}
+
+/**
+ * Same as colors_to_pixels(), but the colors are given as one array per component.
+ */
+void lanes_to_pixels(GPixel dst[], const float a[], const float r[], const float g[], const float b[], int count) {
+    int i = 0;
+#if defined(G_SIMD_AVX2)
+    if (cpu_has_avx2()) i = avx2::lanes_to_pixels(dst, a, r, g, b, count);
+#endif
+#if defined(G_SIMD_SSE2)
+    i += sse2::lanes_to_pixels(dst + i, a + i, r + i, g + i, b + i, count - i);
+#endif
+    for (; i < count; i++) {
+        dst[i] = color_to_pixel(GColor::MakeARGB(a[i], r[i], g[i], b[i]));
+    }
+}
+
+/**
+ * Writes premul pixels for a linear color ramp. Every pixel is computed from [start] and its
+ * index, so lanes are independent of each other.
+ */
+void ramp_to_pixels(GPixel dst[], const GColor& start, const GColor& delta, int count) {
+    int i = 0;
+#if defined(G_SIMD_AVX2)
+    if (cpu_has_avx2()) i = avx2::ramp_to_pixels(dst, start, delta, i, count);
+#endif
+#if defined(G_SIMD_SSE2)
+    i = sse2::ramp_to_pixels(dst, start, delta, i, count);
+#endif
+    for (; i < count; i++) {
+        dst[i] = color_to_pixel(GColor::MakeARGB(start.fA + i * delta.fA, start.fR + i * delta.fR,
+                                                 start.fG + i * delta.fG, start.fB + i * delta.fB));
+    }
+}
+
+/**
+ * Looks up each position in [0, 1] in a table of premul pixels spread evenly over [0, 1].
+ */
+void lut_to_pixels(GPixel dst[], const GPixel lut[], int lut_size, const float position[], int count) {
+    int i = 0;
+#if defined(G_SIMD_AVX2)
+    if (cpu_has_avx2()) i = avx2::lut_to_pixels(dst, lut, lut_size, position, count);
+#endif
+    const float scale = lut_size - 1;
+    for (; i < count; i++) {
+        dst[i] = lut[(int)(position[i] * scale + 0.5f)];
+    }
+}
@@ -2,10 +2,11 @@
 #include <GColor.h>
 #include <GMatrix.h>
 #include <GShader.h>
-
-static inline int Div255(int x) {
-    return ((x + 128) * 257) >> 16;
-}
+#include <MoreShaders.h>
+#include <BlendSpan.h>
+#include <Simd.h>
+#include <algorithm>
+#include <vector>
 
 /**
  * Takes two pixels and modulates them together by multiplying
@@ -19,27 +20,117 @@ static GPixel modulate(GPixel pixel1, GPixel pixel2) {
     return GPixel_PackARGB(A, R, G, B);
 }
 
+/**
+ * Takes two pixels and adds their components, saturating at 255.
+ * Premul pixels stay premul, since each color is still at most the alpha.
+ */
+static GPixel add(GPixel pixel1, GPixel pixel2) {
+    int A = std::min(GPixel_GetA(pixel1) + GPixel_GetA(pixel2), 255);
+    int R = std::min(GPixel_GetR(pixel1) + GPixel_GetR(pixel2), 255);
+    int G = std::min(GPixel_GetG(pixel1) + GPixel_GetG(pixel2), 255);
+    int B = std::min(GPixel_GetB(pixel1) + GPixel_GetB(pixel2), 255);
+    return GPixel_PackARGB(A, R, G, B);
+}
 
 /**
- * This shader's job is to work as proxy between two other shaders,
- * [CanvasShader] and a [CanvasGradient]. This shader's shadeRow will
- * call each of these subclasses' shadeRow and transform the returned pixels
- * into one pixel.
+ * Takes two pixels and moves from the first towards the second by [weight] / 256.
+ */
+static GPixel lerp(GPixel pixel1, GPixel pixel2, int weight) {
+    int A = (GPixel_GetA(pixel1) * (256 - weight) + GPixel_GetA(pixel2) * weight + 128) >> 8;
+    int R = (GPixel_GetR(pixel1) * (256 - weight) + GPixel_GetR(pixel2) * weight + 128) >> 8;
+    int G = (GPixel_GetG(pixel1) * (256 - weight) + GPixel_GetG(pixel2) * weight + 128) >> 8;
+    int B = (GPixel_GetB(pixel1) * (256 - weight) + GPixel_GetB(pixel2) * weight + 128) >> 8;
+    return GPixel_PackARGB(A, R, G, B);
+}
+
+
+/**
+ * This shader's job is to work as proxy between N other shaders. Its
+ * shadeRow calls each shader's shadeRow and folds the returned pixels,
+ * left to right, into one pixel with the compose op.
+ *
+ * The shaders run on chunks of pixels: the first shader writes straight
+ * into the row, and every later shader writes into a chunk on the stack
+ * that is combined into the row while it is in L1. The packed combines
+ * are cheaper than unpacking every shader into pipeline stages.
  */
 class ComposeShader: public GShader {
     public:
-    
+
     // Constructor.
-    ComposeShader(GShader* _colorShader, GShader* _gradientShader) : colorShader(_colorShader), gradientShader(_gradientShader) {}
+    ComposeShader(GShader* const _shaders[], int _count, GComposeOp _op, float _weight, GBlendMode _mode)
+        : shaders(_shaders, _shaders + _count), op(_op), mode(_mode) {
+        weight = GRoundToInt(GPinToUnit(_weight) * 256);
+        blend_row = get_blend_row(mode);
+    }
 
     // Return true iff all of the GPixels that may be returned by this shader will be opaque.
     bool isOpaque() {
-        return colorShader->isOpaque() && gradientShader->isOpaque();
+        // Adding to (or drawing over) an opaque pixel gives an opaque pixel.
+        bool any_opaque = false;
+        bool all_opaque = true;
+        for (GShader* shader : shaders) {
+            bool opaque = shader->isOpaque();
+            any_opaque |= opaque;
+            all_opaque &= opaque;
+        }
+
+        switch (op) {
+            case GComposeOp::kModulate:
+            case GComposeOp::kLerp:
+                return all_opaque;
+            case GComposeOp::kAdd:
+                return any_opaque;
+            case GComposeOp::kBlend:
+                return mode == GBlendMode::kSrcOver && any_opaque;
+        }
+        return false;
     }
 
     // The draw calls in GCanvas must call this with the CTM before any calls to shadeSpan().
     bool setContext(const GMatrix& new_ctm) {
-        return colorShader->setContext(new_ctm) && gradientShader->setContext(new_ctm);
+        for (GShader* shader : shaders) {
+            if (!shader->setContext(new_ctm)) return false;
+        }
+        return true;
+    }
+
+    // Every shader takes the new CTM.
+    bool updateContext(const GMatrix& new_ctm) {
+        for (GShader* shader : shaders) {
+            if (!shader->updateContext(new_ctm)) return false;
+        }
+        return true;
+    }
+
+    // Combining row-constant shaders pixel by pixel is row-constant.
+    bool isRowConstant() {
+        for (GShader* shader : shaders) {
+            if (!shader->isRowConstant()) return false;
+        }
+        return true;
+    }
+
+    // So is combining shaders whose rows are all the same.
+    bool isColumnConstant() {
+        for (GShader* shader : shaders) {
+            if (!shader->isColumnConstant()) return false;
+        }
+        return true;
+    }
+
+    // All shaders interpolate with the same precision.
+    void setPrecision(Precision precision) {
+        for (GShader* shader : shaders) {
+            shader->setPrecision(precision);
+        }
+    }
+
+    // Any of the shaders may read the changed pixels.
+    void notifyPixelsChanged() {
+        for (GShader* shader : shaders) {
+            shader->notifyPixelsChanged();
+        }
     }
 
     /**
@@ -48,25 +139,73 @@ class ComposeShader: public GShader {
      *  can hold at least [count] entries.
      */
     void shadeRow(int x, int y, int count, GPixel row[]) {
-        // Creating two arrays of colors.
-        GPixel tmp[count];
-        colorShader->shadeRow(x, y, count, tmp);
-        gradientShader->shadeRow(x, y, count, row);
-
-        // Combining two pixels together to produce a single pixel to save to row.
-        for (int i = 0; i < count; i++) {
-            row[i] = modulate(tmp[i], row[i]);
+        GPixel scratch[kChunk];
+        for (int start = 0; start < count; start += kChunk) {
+            int chunk = std::min(kChunk, count - start);
+            shaders[0]->shadeRow(x + start, y, chunk, row + start);
+            for (size_t i = 1; i < shaders.size(); i++) {
+                shaders[i]->shadeRow(x + start, y, chunk, scratch);
+                combine(row + start, scratch, chunk);
+            }
         }
     }
 
     private:
-        GShader* colorShader;
-        GShader* gradientShader;
+        // Folds src[] into dst[] with the compose op.
+        void combine(GPixel dst[], const GPixel src[], int count) {
+            switch (op) {
+                case GComposeOp::kModulate:
+                    for (int i = 0; i < count; i++) {
+                        dst[i] = modulate(dst[i], src[i]);
+                    }
+                    break;
+                case GComposeOp::kAdd: {
+                    int i = 0;
+#if defined(G_SIMD_SSE2)
+                    for (; i + 4 <= count; i += 4) {
+                        __m128i sum = _mm_adds_epu8(_mm_loadu_si128((const __m128i*)(dst + i)),
+                                                    _mm_loadu_si128((const __m128i*)(src + i)));
+                        _mm_storeu_si128((__m128i*)(dst + i), sum);
+                    }
+#endif
+                    for (; i < count; i++) {
+                        dst[i] = add(dst[i], src[i]);
+                    }
+                    break;
+                }
+                case GComposeOp::kLerp:
+                    for (int i = 0; i < count; i++) {
+                        dst[i] = lerp(dst[i], src[i], weight);
+                    }
+                    break;
+                case GComposeOp::kBlend:
+                    blend_row(dst, src, count);
+                    break;
+            }
+        }
+
+        // Pixels shaded per pass; a chunk of every shader fits in L1.
+        static constexpr int kChunk = 64;
+
+        std::vector<GShader*> shaders;
+        GComposeOp op;
+        int weight;
+        GBlendMode mode;
+        blend_row_proc blend_row;
 };
 
 /**
- *  Return a subclass of GShader that takes two shaders and blends their pixels.
+ *  Return a subclass of GShader that takes two shaders and modulates their pixels.
  */
 std::unique_ptr<GShader> GCreateComposeShader(GShader* _colorShader, GShader* _gradientShader) {
-    return std::unique_ptr<GShader>(new ComposeShader(_colorShader, _gradientShader)); 
-}
\ No newline at end of file
+    GShader* shaders[] = { _colorShader, _gradientShader };
+    return GCreateComposeShader(shaders, 2, GComposeOp::kModulate);
+}
+
+/**
+ *  Return a subclass of GShader that folds the pixels of [count] shaders with the compose op.
+ */
+std::unique_ptr<GShader> GCreateComposeShader(GShader* const shaders[], int count, GComposeOp op, float weight, GBlendMode mode) {
+    if (count < 1) return nullptr;
+    return std::unique_ptr<GShader>(new ComposeShader(shaders, count, op, weight, mode));
+}
@@ -11,10 +11,11 @@
 #include <Polygon.h>
 #include <Blitter.h>
 #include <Bezier.h>
+#include <Mesh.h>
+#include <Arena.h>
 #include <stack>
 #include <vector> 
 #include <GShader.h>
-#include <MoreShaders.h>
 
 struct Edge;
 class GBitmap;
@@ -25,7 +26,6 @@ class GRect;
 class Blitter;
 enum class GBlendMode;
 bool sortEdges(const Edge& edge1, const Edge& edge2);
-bool sortEdgesByX(const Edge& edge1, const Edge& edge2);
 
 class EmptyCanvas: public GCanvas {
     public: 
@@ -69,25 +69,59 @@ class EmptyCanvas: public GCanvas {
         ctm.top().preConcat(matrix);
     }
 
+    // Selects the precision shaders interpolate colors with for all following draws.
+    void setShadingPrecision(GShader::Precision new_precision) override {
+        precision = new_precision;
+    }
+
+    // Sets how far the flattening of curves may stray from them for all following draws.
+    void setCurveTolerance(float new_tolerance) override {
+        if (new_tolerance > 0) tolerance = new_tolerance;
+    }
+
     // Sets the paint of the canvas with the given paint and blendmode.
     void drawPaint(const GPaint& src) override {
         // Cases where no work needs to be done (just kDst).
-        if (!src.getShader() && willReturnDst(src.getBlendMode(), src.getAlpha())) return;
-
-        // Creating blitter.
-        Blitter blitter = Blitter(src, bit_map, ctm.top());
-        
-        // Looping through the entirety of [bit_map] and repainting each pixel.
-        for (int y = 0; y < bit_map.height(); y++) {
-            blitter.blit(y, 0, bit_map.width() - 1);
-        }
+        if (willReturnDst(src)) return;
+
+        // Repainting the entirety of [bit_map].
+        ArenaScope scope(arena);
+        Blitter blitter(src, bit_map, ctm.top(), precision, arena);
+        blitter.blit_rect(GIRect::MakeWH(bit_map.width(), bit_map.height()));
     }
 
     // Fills a rectangular section of the canvas with the given rectangle dimensions
     // and fills the destination pixel with the src color.
     void drawRect(const GRect& rect, const GPaint& src) override {
         // Cases where no work needs to be done (just kDst).
-        if (!src.getShader() && willReturnDst(src.getBlendMode(), src.getAlpha())) return;
+        if (willReturnDst(src)) return;
+
+        // Axis-aligned rectangles (identity or scale/translate CTM) skip edge building.
+        const GMatrix& matrix = ctm.top();
+        if (matrix[GMatrix::KX] == 0 && matrix[GMatrix::KY] == 0) {
+            GPoint corners[2] = {
+                GPoint::Make(rect.fLeft, rect.fTop),
+                GPoint::Make(rect.fRight, rect.fBottom)
+            };
+            matrix.mapPoints(corners, 2);
+
+            // Clipping to [bit_map] in float, so the corners always fit in an int.
+            float width = (float)bit_map.width();
+            float height = (float)bit_map.height();
+            float left = std::max(std::min(corners[0].fX, corners[1].fX), 0.0f);
+            float top = std::max(std::min(corners[0].fY, corners[1].fY), 0.0f);
+            float right = std::min(std::max(corners[0].fX, corners[1].fX), width);
+            float bottom = std::min(std::max(corners[0].fY, corners[1].fY), height);
+
+            // Rounding keeps the pixels whose centers are contained: center > min_edge && center <= max_edge.
+            GIRect bounds = GRect::MakeLTRB(left, top, right, bottom).round();
+            if (bounds.isEmpty()) return;
+
+            ArenaScope scope(arena);
+            Blitter blitter(src, bit_map, matrix, precision, arena);
+            blitter.blit_rect(bounds);
+            return;
+        }
 
         // Making a points array to use as an argument for mapPoints.
         const GPoint points[4] = {
@@ -113,19 +147,21 @@ class EmptyCanvas: public GCanvas {
     */
     void drawConvexPolygon(const GPoint org_points[], int count, const GPaint& src) override {
         // Cases where no work needs to be done (just kDst).
-        if (willReturnDst(src.getBlendMode(), src.getAlpha()) && !src.getShader()) return;
+        if (willReturnDst(src)) return;
+
+        ArenaScope scope(arena);
 
         // Mapping each point post-ctm operations and placing them into [points].
-        GPoint points[sizeof(GPoint) * count];
+        GPoint* points = arena.make<GPoint>(count);
         ctm.top().mapPoints(points, org_points, count);
 
         // Creating edges and sorting them.
-        std::vector <Edge> edges;
-        find_edges(edges, points, count, bit_map);
-        std::sort(edges.begin(), edges.end(), sortEdges);
+        Edge* edges = arena.make<Edge>(3 * count);
+        int edge_count = find_edges(edges, points, count, bit_map);
+        std::sort(edges, edges + edge_count, sortEdges);
 
         // Return if there are no edges to apply.
-        if (edges.empty()) return;
+        if (edge_count == 0) return;
 
         // Two comparison edges.
         Edge e0 = edges[0];
@@ -133,11 +169,11 @@ class EmptyCanvas: public GCanvas {
         int i = 1;
 
         // Blitter.
-        Blitter blitter = Blitter(src, bit_map, ctm.top());
+        Blitter blitter(src, bit_map, ctm.top(), precision, arena);
 
         // Global min_y and max_y.
-        int global_top = GRoundToInt(edges[0].min_y);
-        int global_bottom = edges[edges.size() - 1].max_y;
+        int global_top = edges[0].min_y;
+        int global_bottom = edges[edge_count - 1].max_y;
 
         // Iterating from the top of the polygon to the bottom.
         for (int y = global_top; y < global_bottom; y++) {
@@ -146,11 +182,14 @@ class EmptyCanvas: public GCanvas {
             assert(e1.legal_y(y));
 
             // Rounding x values and blitting.
-            int x0 = GRoundToInt(e0.x);
-            int x1 = GRoundToInt(e1.x);
+            int x0 = e0.round_x();
+            int x1 = e1.round_x();
             assert(x0 <= x1);
             blitter.blit(y, x0, x1);
 
+            // The last row has no next edges to load.
+            if (y + 1 == global_bottom) break;
+
             // Check [e0].
             if (e0.legal_y(y + 1)) {
                 e0.x += e0.m;
@@ -174,47 +213,99 @@ class EmptyCanvas: public GCanvas {
      */
     void drawPath(const GPath& path, const GPaint& src) {
         // Cases where no work needs to be done (just kDst).
-        if (willReturnDst(src.getBlendMode(), src.getAlpha()) && !src.getShader()) return;
+        if (willReturnDst(src)) return;
 
-        // Transforming each point by the current ctm.
-        GPath copy_path = path;
-        copy_path.transform(ctm.top());
+        ArenaScope scope(arena);
+        const GMatrix& matrix = ctm.top();
 
-        // Finding edges.
-        std::vector <Edge> edges;
-        GPath::Edger iter(copy_path);
+        // Counting the segments first, so the edges are one arena allocation. A line makes at
+        // most 3 edges (itself and two border edges), and a curve at most 3 monotonic pieces
+        // (or 1 border edge when only its chord is drawn).
+        int lines = 0;
+        int curves = 0;
+        GPath::Edger counter(path);
+        for (;;) {
+            GPoint pts[GPath::kMaxNextPoints];
+            GPath::Verb v = counter.next(pts);
+            if (v == GPath::kDone) break;
+            lines += v == GPath::kLine;
+            curves += v == GPath::kQuad ? 2 : v == GPath::kCubic ? 3 : 0;
+        }
+
+        // Finding edges. Each edge of a curve is the first line of a CurveEdge.
+        int capacity = 3 * lines + curves;
+        Edge* edges = arena.make<Edge>(capacity);
+        int* edge_curves = arena.make<int>(capacity);
+        CurveEdge* curve_edges = arena.make<CurveEdge>(curves);
+        int edge_count = 0;
+        int curve_count = 0;
+        GPath::Edger iter(path);
         for (;;) {
             GPoint pts[GPath::kMaxNextPoints];  // enough storage for each call to next()
             GPath::Verb v = iter.next(pts);
             if (v == GPath::kDone) {
                 break;  // we're done with the loop
             }
-            int numOfEdges;
             switch (v) {
                 case GPath::kLine:
-                    find_edges(edges, pts, 1, bit_map, false);
+                {
+                    matrix.mapPoints(pts, 2);
+                    int count = find_edges(edges + edge_count, pts, 1, bit_map, false);
+                    std::fill(edge_curves + edge_count, edge_curves + edge_count + count, -1);
+                    edge_count += count;
+                }
                     break;
                 case GPath::kQuad:
                 {
-                    // Finding the number of edges and creates an array to their points.
-                    numOfEdges = quadSegments(pts);
-                    GPoint quadPts[numOfEdges + 1];
-
-                    // Finding points on the quadratic bezier curve and creating edges.
-                    createQuadPts(pts, quadPts, numOfEdges);
-                    find_edges(edges, quadPts, numOfEdges, bit_map, false);
+                    // Curves off the bit_map are dropped or drawn as their chord.
+                    matrix.mapPoints(pts, 3);
+                    HullClip clip = clip_hull(pts, 3, bit_map);
+                    if (clip == kNone_HullClip) break;
+                    if (clip == kChord_HullClip) {
+                        pts[1] = pts[2];
+                        int count = find_edges(edges + edge_count, pts, 1, bit_map, false);
+                        std::fill(edge_curves + edge_count, edge_curves + edge_count + count, -1);
+                        edge_count += count;
+                        break;
+                    }
+
+                    // Chopping the curve into pieces that only move down (or up).
+                    GPoint pieces[5];
+                    int numOfPieces = chopQuadAtYExtrema(pts, pieces);
+
+                    for (int i = 0; i < numOfPieces; i++) {
+                        int numOfEdges = std::max(quadSegments(pieces + 2*i, tolerance), 1);
+                        if (curve_edges[curve_count].setup(pieces + 2*i, 2, numOfEdges, edges + edge_count, bit_map)) {
+                            edge_curves[edge_count++] = curve_count++;
+                        }
+                    }
                 }
                     break;
 
                 case GPath::kCubic:
                 {
-                    // Finding the number of edges and creates an array to their points.
-                    numOfEdges = cubicSegments(pts);
-                    GPoint cubicPts[numOfEdges + 1];
-
-                    // Finding points on the cubic bezier curve and creating edges.
-                    createCubicPts(pts, cubicPts, numOfEdges);
-                    find_edges(edges, cubicPts, numOfEdges, bit_map, false);
+                    // Curves off the bit_map are dropped or drawn as their chord.
+                    matrix.mapPoints(pts, 4);
+                    HullClip clip = clip_hull(pts, 4, bit_map);
+                    if (clip == kNone_HullClip) break;
+                    if (clip == kChord_HullClip) {
+                        pts[1] = pts[3];
+                        int count = find_edges(edges + edge_count, pts, 1, bit_map, false);
+                        std::fill(edge_curves + edge_count, edge_curves + edge_count + count, -1);
+                        edge_count += count;
+                        break;
+                    }
+
+                    // Chopping the curve into pieces that only move down (or up).
+                    GPoint pieces[10];
+                    int numOfPieces = chopCubicAtYExtrema(pts, pieces);
+
+                    for (int i = 0; i < numOfPieces; i++) {
+                        int numOfEdges = std::max(cubicSegments(pieces + 3*i, tolerance), 1);
+                        if (curve_edges[curve_count].setup(pieces + 3*i, 3, numOfEdges, edges + edge_count, bit_map)) {
+                            edge_curves[edge_count++] = curve_count++;
+                        }
+                    }
                 }
                     break;
 
@@ -222,61 +313,52 @@ class EmptyCanvas: public GCanvas {
             }
         }
 
-        // Sorting edges.
-        std::sort(edges.begin(), edges.end(), sortEdges);
-
         // Return if there are no edges to apply.
-        if (edges.empty()) return;
+        if (edge_count == 0) return;
+
+        // Global edge table: the edges in the order they become active.
+        int* order = bucket_edges(edges, edge_count, bit_map, arena);
+        ActiveEdges active(arena, edge_count, curve_edges, bit_map);
 
         // Blitter.
-        Blitter blitter = Blitter(src, bit_map, ctm.top());
-        int count = edges.size();
+        Blitter blitter(src, bit_map, ctm.top(), precision, arena);
+        int next = 0;
 
         // Shooting scan lines from the top to the bottom.
-        for (int y = GRoundToInt(edges[0].min_y); count > 0; y++) {
-            int i = 0;
-            int w = 0;
-            int start_x  = 0;
+        for (int y = edges[order[0]].min_y; next < edge_count || active.count > 0; y++) {
+            // Skipping rows that no edge crosses.
+            if (active.count == 0) {
+                y = edges[order[next]].min_y;
+            }
 
-            // Looks for edges that intersect with the scan line.
-            while (i < count && edges[i].min_y <= y) {
-                // Renaming edge[i].
-                Edge& currentEdge = edges[i];
+            // Edges that start on this row join the active edge table.
+            while (next < edge_count && edges[order[next]].min_y == y) {
+                active.add(edges[order[next]], edge_curves[order[next]]);
+                next++;
+            }
+            active.sort_by_x();
 
+            int w = 0;
+            int start_x = 0;
+            for (int i = 0; i < active.count; i++) {
                 // Setting [start_x].
                 if (w == 0) {
-                    start_x = GRoundToInt(currentEdge.x);
+                    start_x = fixed_round(active.x[i]);
                 }
 
                 // Incrementing w.
-                w += currentEdge.w;
+                w += active.w[i];
 
                 // Setting [end_x] and blitting.
                 if (w == 0) {
-                    int end_x = GRoundToInt(currentEdge.x);
+                    int end_x = fixed_round(active.x[i]);
                     assert(start_x <= end_x);
                     blitter.blit(y, start_x, end_x);
                 }
-
-                // Erasing edge and reducing the count.
-                if (y + 1 == currentEdge.max_y) {
-                    edges.erase(edges.begin() + i);
-                    count -= 1;
-                    
-                // Incrementing x.
-                } else {
-                    currentEdge.x += currentEdge.m;
-                    i += 1;
-                }
-            }
-
-            // Finding any future edges to add to be sorted by x.
-            while (i < count && edges[i].min_y <= y + 1) {
-                i += 1;
             }
 
-            // Re-sort by x.
-            std::sort(edges.begin(), edges.begin() + i, sortEdgesByX);
+            // Stepping the edges to the next row and retiring the ones that end here.
+            active.step(y);
         }
     }
 
@@ -308,11 +390,12 @@ class EmptyCanvas: public GCanvas {
         int numOfTri   = numOfQuads * 2;
         int numOfPts   = numOfTri * 3;
 
-        // Initializing arrays.
-        GPoint newVerts[numOfVerts];
-        GColor vertColors[numOfVerts];
-        GPoint vertTexs[numOfVerts];
-        int indices[numOfPts];
+        // Initializing arrays. drawMesh() opens its own scope, so these stay alive through it.
+        ArenaScope scope(arena);
+        GPoint* newVerts   = arena.make<GPoint>(numOfVerts);
+        GColor* vertColors = arena.make<GColor>(numOfVerts);
+        GPoint* vertTexs   = arena.make<GPoint>(numOfVerts);
+        int*    indices    = arena.make<int>(numOfPts);
 
         // Iterating variables.
         int i, j, width, count;
@@ -392,87 +475,36 @@ class EmptyCanvas: public GCanvas {
      *  together, component by component.
      */
     void drawMesh(const GPoint verts[], const GColor colors[], const GPoint texs[], int count, const int indices[], const GPaint& orig_paint) {
-        // Nothing to draw.
-        if (colors == nullptr && texs == nullptr) return;
-
-        // Defining paint and shaders.
-        GPaint paint = orig_paint;
-        std::unique_ptr<GShader> tri_shader, proxy_shader, compose_shader;
-
-        int n = 0;
-        for (int i = 0; i < count; ++i) {
-            // Defining pts.
-            const GPoint pts[] = {
-                verts[indices[n+0]],
-                verts[indices[n+1]],
-                verts[indices[n+2]]
-            };
-
-            // ComposeShader case.
-            if (colors != nullptr && texs != nullptr) {
-                const GColor triColors[] = {
-                    colors[indices[n+0]],
-                    colors[indices[n+1]],
-                    colors[indices[n+2]]
-                };
-
-                const GPoint proxyCoords[] = {
-                    texs[indices[n+0]],
-                    texs[indices[n+1]],
-                    texs[indices[n+2]]
-                };
-
-                // Setting the paint's shader.
-                assert(paint.getShader() != nullptr);
-                tri_shader     = GCreateTriColorShader(pts, triColors);
-                proxy_shader   = GCreateProxyShader(orig_paint.getShader(), pts, proxyCoords);
-                compose_shader = GCreateComposeShader(proxy_shader.get(), tri_shader.get());
-                paint.setShader(compose_shader.get());
-            }
-
-            // TriColor case.
-            else if (colors != nullptr) {
-                GColor triColors[] = {
-                    colors[indices[n+0]],
-                    colors[indices[n+1]],
-                    colors[indices[n+2]]
-                };
-
-                // Setting the paint's shader.
-                tri_shader = GCreateTriColorShader(pts, triColors);
-                paint.setShader(tri_shader.get());
-            }
-
-            // ProxyShader case.
-            else {
-                GPoint proxyCoords[] = {
-                    texs[indices[n+0]],
-                    texs[indices[n+1]],
-                    texs[indices[n+2]]
-                };
-
-                // Setting the paint's shader.
-                assert(paint.getShader() != nullptr);
-                proxy_shader = GCreateProxyShader(orig_paint.getShader(), pts, proxyCoords);
-                paint.setShader(proxy_shader.get());
-            }
+        // The rasterizer maps the vertices once and shades each triangle without a shader of its own.
+        ArenaScope scope(arena);
+        mesh.draw(bit_map, ctm.top(), verts, colors, texs, count, indices, orig_paint, precision, arena);
+    }
 
-            // Delegate the drawing to drawConvexPolygon.
-            drawConvexPolygon(pts, 3, paint);
+    /**
+     *  Ends a frame. The arena keeps one block big enough for the largest frame so far, so later
+     *  frames draw without touching the heap.
+     */
+    void flush() override {
+        arena.reset();
+    }
 
-            // Incrementing.
-            n += 3;
-        }
+    // The most transient memory the draws have needed at once, in bytes.
+    size_t transientHighWaterMark() const override {
+        return arena.highWaterMark();
     }
     
     private:
         const GBitmap bit_map;
         std::stack <GMatrix> ctm;
+        GShader::Precision precision = GShader::kFloat_Precision;
+        float tolerance = kCurveTolerance;
+        MeshRasterizer mesh;
+        Arena arena;    // transient memory of the draw in progress.
 };
 
-// Returns a new canvas.
+// Returns a new canvas, or null for devices too large for the edges' 16-bit rows and 16.16 x.
 std::unique_ptr<GCanvas> GCreateCanvas(const GBitmap& device) {
-    if (!device.pixels()) {
+    if (!device.pixels() || device.width() > kMaxDeviceSize || device.height() > kMaxDeviceSize) {
         return nullptr;
     }
     return std::unique_ptr<GCanvas>(new EmptyCanvas(device));
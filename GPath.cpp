@@ -1,6 +1,5 @@
 #include <GPath.h>
 #include <GMatrix.h>
-#include <Bezier.h>
 class GMatrix;
 
 /**
@@ -99,7 +98,7 @@ void GPath::ChopQuadAt(const GPoint src[3], GPoint dst[5], float t) {
     dst[0] = A;
     dst[1] = AB;
     // t is the shared point.
-    dst[2] = calculateQuad(A, B, C, t);
+    dst[2] = (1 - t)*AB + BC*t;
     // t + 1...1.
     dst[3] = BC;
     dst[4] = C;
@@ -127,11 +126,11 @@ void GPath::ChopCubicAt(const GPoint src[4], GPoint dst[7], float t) {
     dst[0] = A;
     dst[1] = AB;
     dst[2] = (1 - t)*AB + BC*t;
-    // t is the shared point.
-    dst[3] = calculateCubic(A, B, C, D, t);
     // t + 1...1.
     dst[4] = (1 - t)*BC + CD*t;
-    dst[5] = BC;
+    // t is the shared point.
+    dst[3] = (1 - t)*dst[2] + dst[4]*t;
+    dst[5] = CD;
     dst[6] = D;
 }
 
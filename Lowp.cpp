@@ -0,0 +1,121 @@
+#include <Lowp.h>
+#include <ColorConvert.h>
+#include <Simd.h>
+#include <algorithm>
+#include <cmath>
+
+bool lowp_supported() {
+#if defined(G_SIMD_SSE2)
+    return true;
+#else
+    return false;
+#endif
+}
+
+#if defined(G_SIMD_SSE2)
+/**
+ * Premultiplies 2 + 2 unpremul 1.15 pixels and packs them into 4 GPixels.
+ *
+ *  P = c*a in 2.14 (alpha lanes are multiplied by 1.0 instead)
+ *  out = round(P * 255 / 16384) = (P - P/256 + 32) / 64
+ */
+static inline __m128i premul_pack(__m128i lo, __m128i hi) {
+    const __m128i alpha_lanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+    const __m128i one = _mm_set1_epi16(32767);
+
+    __m128i px[2] = { lo, hi };
+    for (int i = 0; i < 2; i++) {
+        __m128i c = _mm_min_epi16(_mm_max_epi16(px[i], _mm_setzero_si128()), one);
+        __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(c, 0xFF), 0xFF);
+        c = _mm_or_si128(_mm_andnot_si128(alpha_lanes, c), _mm_and_si128(alpha_lanes, one));
+        __m128i p = _mm_mulhi_epi16(c, a);
+        p = _mm_sub_epi16(p, _mm_srli_epi16(p, 8));
+        px[i] = _mm_srli_epi16(_mm_add_epi16(p, _mm_set1_epi16(32)), 6);
+    }
+    return _mm_packus_epi16(px[0], px[1]);
+}
+
+// Loads the colors of two pixels into one register.
+static inline __m128i load2(const LowpColor& c0, const LowpColor& c1) {
+    return _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)&c0), _mm_loadl_epi64((const __m128i*)&c1));
+}
+
+/**
+ * Lerps two pixels: c0 + (c1 - c0)*w, with w broadcast per pixel.
+ *
+ *  P = (c1 - c0)*w is 32 bits; round(P / 2^15) = (hi << 1) + (lo >> 15) + bit 14 of lo.
+ */
+static inline __m128i lerp2(const LowpColor colors[], const int index[], const int16_t weight[], int i) {
+    __m128i c0 = load2(colors[index[i]],     colors[index[i + 1]]);
+    __m128i c1 = load2(colors[index[i] + 1], colors[index[i + 1] + 1]);
+    __m128i w  = _mm_unpacklo_epi64(_mm_set1_epi16(weight[i]), _mm_set1_epi16(weight[i + 1]));
+    __m128i diff = _mm_sub_epi16(c1, c0);
+    __m128i lo = _mm_mullo_epi16(diff, w);
+    __m128i hi = _mm_mulhi_epi16(diff, w);
+    __m128i d  = _mm_add_epi16(_mm_slli_epi16(hi, 1), _mm_srli_epi16(lo, 15));
+    d = _mm_add_epi16(d, _mm_and_si128(_mm_srli_epi16(lo, 14), _mm_set1_epi16(1)));
+    return _mm_add_epi16(c0, d);
+}
+#endif
+
+// The float path for one pixel of lowp_lerp_to_pixels().
+static inline GPixel lerp_pixel(const LowpColor& c0, const LowpColor& c1, int16_t weight) {
+    float t = weight * (1.0f / 32767);
+    return color_to_pixel(GColor::MakeARGB(
+        (c0.a + (c1.a - c0.a) * t) * (1.0f / 32767),
+        (c0.r + (c1.r - c0.r) * t) * (1.0f / 32767),
+        (c0.g + (c1.g - c0.g) * t) * (1.0f / 32767),
+        (c0.b + (c1.b - c0.b) * t) * (1.0f / 32767)
+    ).pinToUnit());
+}
+
+// The float path for pixel [i] of lowp_ramp_to_pixels().
+static inline GPixel ramp_pixel(const GColor& start, const GColor& delta, int i) {
+    return color_to_pixel(GColor::MakeARGB(start.fA + i * delta.fA, start.fR + i * delta.fR,
+                                           start.fG + i * delta.fG, start.fB + i * delta.fB).pinToUnit());
+}
+
+void lowp_lerp_to_pixels(GPixel dst[], const LowpColor colors[], const int index[], const int16_t weight[], int count) {
+    int i = 0;
+#if defined(G_SIMD_SSE2)
+    for (; i + 4 <= count; i += 4) {
+        __m128i p = premul_pack(lerp2(colors, index, weight, i), lerp2(colors, index, weight, i + 2));
+        _mm_storeu_si128((__m128i*)(dst + i), p);
+    }
+#endif
+    // Leftover pixels take the float path.
+    for (; i < count; i++) {
+        dst[i] = lerp_pixel(colors[index[i]], colors[index[i] + 1], weight[i]);
+    }
+}
+
+void lowp_ramp_to_pixels(GPixel dst[], const GColor& start, const GColor& delta, int count) {
+    int i = 0;
+#if defined(G_SIMD_SSE2)
+    // Each group of 8 pixels starts from an exact float color, then steps two pixels at a
+    // time in 16 bits. Steeper ramps than that can hold all take the float path.
+    bool fits = std::max(std::max(fabsf(delta.fA), fabsf(delta.fR)), std::max(fabsf(delta.fG), fabsf(delta.fB))) < 0.5f;
+    if (fits) {
+        LowpColor step = {
+            (int16_t)(2 * delta.fB * 32767), (int16_t)(2 * delta.fG * 32767),
+            (int16_t)(2 * delta.fR * 32767), (int16_t)(2 * delta.fA * 32767)
+        };
+        __m128i d = load2(step, step);
+        for (; i + 8 <= count; i += 8) {
+            GColor c0 = GColor::MakeARGB(start.fA + i * delta.fA, start.fR + i * delta.fR,
+                                         start.fG + i * delta.fG, start.fB + i * delta.fB);
+            GColor c1 = GColor::MakeARGB(c0.fA + delta.fA, c0.fR + delta.fR, c0.fG + delta.fG, c0.fB + delta.fB);
+            __m128i p0 = load2(to_lowp(c0), to_lowp(c1));
+            __m128i p1 = _mm_adds_epi16(p0, d);
+            __m128i p2 = _mm_adds_epi16(p1, d);
+            __m128i p3 = _mm_adds_epi16(p2, d);
+            _mm_storeu_si128((__m128i*)(dst + i),     premul_pack(p0, p1));
+            _mm_storeu_si128((__m128i*)(dst + i + 4), premul_pack(p2, p3));
+        }
+    }
+#endif
+    // Leftover pixels take the float path.
+    for (; i < count; i++) {
+        dst[i] = ramp_pixel(start, delta, i);
+    }
+}
@@ -0,0 +1,223 @@
+#include <Mesh.h>
+#include <GMath.h>
+#include <ColorConvert.h>
+#include <Lowp.h>
+#include <Simd.h>
+#include <algorithm>
+
+// Returns a + b * t, per component.
+static inline GColor mad(const GColor& a, const GColor& b, float t) {
+    return GColor::MakeARGB(a.fA + b.fA * t, a.fR + b.fR * t, a.fG + b.fG * t, a.fB + b.fB * t);
+}
+
+// Returns a - b, per component.
+static inline GColor sub(const GColor& a, const GColor& b) {
+    return GColor::MakeARGB(a.fA - b.fA, a.fR - b.fR, a.fG - b.fG, a.fB - b.fB);
+}
+
+/**
+ * Returns the x of the edge p -> q (p above q) at height y.
+ *
+ * Every triangle walks a shared edge from the same upper vertex, so both sides of the edge
+ * compute the same x and the triangles neither overlap nor leave gaps.
+ */
+static inline float edge_x(GPoint p, GPoint q, float y) {
+    float dy = q.fY - p.fY;
+    if (dy == 0) return p.fX;
+    return p.fX + (y - p.fY) * ((q.fX - p.fX) / dy);
+}
+
+// Returns the matrix that maps (1, 0) to p1 - p0, (0, 1) to p2 - p0 and (0, 0) to p0.
+static inline GMatrix basis(GPoint p0, GPoint p1, GPoint p2) {
+    return GMatrix(
+        p1.fX - p0.fX, p2.fX - p0.fX, p0.fX,
+        p1.fY - p0.fY, p2.fY - p0.fY, p0.fY
+    );
+}
+
+/**
+ * dst[i] = dst[i] * src[i] / 255 per component, rounded the same way as the compose shader's
+ * modulate. (x + 128) * 257 >> 16 fits 16-bit lanes, so the SIMD loop gives the same pixels.
+ */
+static void modulate_row(GPixel dst[], const GPixel src[], int count) {
+    int i = 0;
+#if defined(G_SIMD_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i half = _mm_set1_epi16(128);
+    const __m128i k257 = _mm_set1_epi16(257);
+    for (; i + 4 <= count; i += 4) {
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero));
+        __m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero));
+        lo = _mm_mulhi_epu16(_mm_add_epi16(lo, half), k257);
+        hi = _mm_mulhi_epu16(_mm_add_epi16(hi, half), k257);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for (; i < count; i++) {
+        GPixel d = dst[i];
+        GPixel s = src[i];
+        dst[i] = GPixel_PackARGB(
+            Div255(GPixel_GetA(d) * GPixel_GetA(s)),
+            Div255(GPixel_GetR(d) * GPixel_GetR(s)),
+            Div255(GPixel_GetG(d) * GPixel_GetG(s)),
+            Div255(GPixel_GetB(d) * GPixel_GetB(s))
+        );
+    }
+}
+
+void MeshRasterizer::draw(const GBitmap& device, const GMatrix& ctm, const GPoint verts[], const GColor colors[],
+                          const GPoint texs[], int count, const int indices[], const GPaint& paint,
+                          GShader::Precision precision, Arena& arena) {
+    // Without a shader the texture coordinates are ignored.
+    GShader* shader = paint.getShader();
+    if (shader == nullptr) texs = nullptr;
+
+    // Nothing to draw.
+    if (count <= 0 || (colors == nullptr && texs == nullptr)) return;
+    if (texs == nullptr) shader = nullptr;
+
+    // Only the vertices up to the largest index are mapped.
+    int vertex_count = 0;
+    for (int i = 0; i < 3 * count; i++) {
+        vertex_count = std::max(vertex_count, indices[i] + 1);
+    }
+    points = arena.make<GPoint>(vertex_count);
+    ctm.mapPoints(points, verts, vertex_count);
+
+    // The src is opaque if both the colors and the texture are.
+    bool opaque = shader == nullptr || shader->isOpaque();
+    for (int i = 0; colors != nullptr && opaque && i < vertex_count; i++) {
+        opaque = colors[i].fA >= 1;
+    }
+    SrcAlpha src_alpha = opaque ? kOpaque_SrcAlpha : kPartial_SrcAlpha;
+    mode = reduce_blend_mode(paint.getBlendMode(), src_alpha);
+    if (mode == GBlendMode::kDst) return;
+    blend_row = get_blend_row(paint.getBlendMode(), src_alpha);
+
+    // A span is at most one device row.
+    dst = &device;
+    row = arena.make<GPixel>(device.width());
+    scratch = arena.make<GPixel>(device.width());
+
+    bool lowp = precision == GShader::kLowp_Precision && lowp_supported();
+    if (shader != nullptr) shader->setPrecision(precision);
+    shader_ready = false;
+
+    // Set up a batch of triangles, then scan convert it.
+    triangles = arena.make<Triangle>(kBatch);
+    for (int start = 0; start < count; start += kBatch) {
+        int batch = 0;
+        for (int i = start; i < std::min(count, start + kBatch); i++) {
+            if (setup(&triangles[batch], indices + 3 * i, colors, texs)) {
+                batch++;
+            }
+        }
+        for (int i = 0; i < batch; i++) {
+            raster(triangles[i], shader, colors != nullptr, lowp);
+        }
+    }
+}
+
+/**
+ * Sets up a triangle from its three vertex indices. Returns false if it covers no device row,
+ * or if it is degenerate on the device or in texture space.
+ */
+bool MeshRasterizer::setup(Triangle* tri, const int vertex[3], const GColor colors[], const GPoint texs[]) const {
+    GPoint p0 = points[vertex[0]];
+    GPoint p1 = points[vertex[1]];
+    GPoint p2 = points[vertex[2]];
+
+    // Sorting the vertices top to bottom.
+    GPoint p[3] = { p0, p1, p2 };
+    if (p[1].fY < p[0].fY) std::swap(p[0], p[1]);
+    if (p[2].fY < p[1].fY) std::swap(p[1], p[2]);
+    if (p[1].fY < p[0].fY) std::swap(p[0], p[1]);
+    tri->top = p[0];
+    tri->middle = p[1];
+    tri->bottom = p[2];
+
+    // Culling triangles that miss the device.
+    tri->y0 = std::max(GRoundToInt(p[0].fY), 0);
+    tri->y1 = std::min(GRoundToInt(p[2].fY), dst->height());
+    if (tri->y0 >= tri->y1) return false;
+    float left = std::min({ p0.fX, p1.fX, p2.fX });
+    float right = std::max({ p0.fX, p1.fX, p2.fX });
+    if (GRoundToInt(right) <= 0 || GRoundToInt(left) >= dst->width()) return false;
+
+    // Device space -> barycentric (u, v), where p = p0 + u(p1 - p0) + v(p2 - p0).
+    GMatrix device = basis(p0, p1, p2);
+    if (!device.invert(&tri->inverse)) return false;
+
+    // color = c0 + u(c1 - c0) + v(c2 - c0), so a step in x moves it by inverse[0] du + inverse[3] dv.
+    if (colors != nullptr) {
+        tri->origin = colors[vertex[0]];
+        tri->du = sub(colors[vertex[1]], tri->origin);
+        tri->dv = sub(colors[vertex[2]], tri->origin);
+        tri->dx = mad(mad(GColor::MakeARGB(0, 0, 0, 0), tri->du, tri->inverse[0]), tri->dv, tri->inverse[3]);
+    }
+
+    // Texture space -> barycentric -> device space.
+    if (texs != nullptr) {
+        GMatrix texture = basis(texs[vertex[0]], texs[vertex[1]], texs[vertex[2]]);
+        GMatrix inverse;
+        if (!texture.invert(&inverse)) return false;
+        tri->texture = device * inverse;
+    }
+    return true;
+}
+
+// Scan converts one triangle, shading and blending a span per row.
+void MeshRasterizer::raster(const Triangle& tri, GShader* shader, bool has_colors, bool lowp) {
+    // The first triangle sets up the shader for the whole draw; the others only change its
+    // matrix, so the shader's tables and caches are not rebuilt per triangle.
+    if (shader != nullptr) {
+        bool ready = shader_ready ? shader->updateContext(tri.texture) : shader->setContext(tri.texture);
+        if (!ready) return;
+        shader_ready = true;
+    }
+
+    for (int y = tri.y0; y < tri.y1; y++) {
+        // The long edge runs top -> bottom; the short one changes at the middle vertex.
+        float cy = y + 0.5f;
+        float xa = edge_x(tri.top, tri.bottom, cy);
+        float xb = cy < tri.middle.fY ? edge_x(tri.top, tri.middle, cy)
+                                      : edge_x(tri.middle, tri.bottom, cy);
+        int x0 = std::max(GRoundToInt(std::min(xa, xb)), 0);
+        int x1 = std::min(GRoundToInt(std::max(xa, xb)), dst->width());
+        if (x0 >= x1) continue;
+
+        int span = x1 - x0;
+        GPixel* out = dst->getAddr(x0, y);
+
+        // The src pixels are never read.
+        if (mode == GBlendMode::kClear) {
+            blend_row(out, nullptr, span);
+            continue;
+        }
+
+        // The src pixels replace dst, so shade straight into it.
+        GPixel* src = mode == GBlendMode::kSrc ? out : row;
+
+        // Each span of a triangle is one linear color ramp.
+        if (has_colors) {
+            GPoint uv = tri.inverse * GPoint::Make(x0 + 0.5f, cy);
+            GColor start = mad(mad(tri.origin, tri.du, uv.fX), tri.dv, uv.fY);
+            if (lowp) {
+                lowp_ramp_to_pixels(src, start, tri.dx, span);
+            } else {
+                ramp_to_pixels(src, start, tri.dx, span);
+            }
+        }
+
+        // The texture is multiplied into the colors, if there are any.
+        if (shader != nullptr) {
+            GPixel* texels = has_colors ? scratch : src;
+            shader->shadeRow(x0, y, span, texels);
+            if (has_colors) modulate_row(src, texels, span);
+        }
+
+        if (mode != GBlendMode::kSrc) blend_row(out, src, span);
+    }
+}
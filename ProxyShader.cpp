@@ -29,30 +29,40 @@ class ProxyShader: public GShader {
         // Rejecting ctm.
         if (det == 0) return false;
 
-        // Defining points.
-        GPoint p0 = pts[0];
-        GPoint p1 = pts[1];
-        GPoint p2 = pts[2];
-
-        GPoint s0 = coords[0];
-        GPoint s1 = coords[1];
-        GPoint s2 = coords[2];
-
-        // Creating the P matrix.
-        GMatrix P = {
-            (p1-p0).fX, (p2-p0).fX, p0.fX,
-            (p1-p0).fY, (p2-p0).fY, p0.fY
-        };
-
-        // Creating the S^-1 matrix.
-        GMatrix S = {
-            (s1-s0).fX, (s2-s0).fX, s0.fX,
-            (s1-s0).fY, (s2-s0).fY, s0.fY
-        };
-        S.invert(&S);
-
         // Setting realShader's ctm to the psuedo ctm.
-        return realShader->setContext(new_ctm * P * S);
+        return realShader->setContext(new_ctm * pseudo_matrix());
+    }
+
+    // The realShader keeps its per-draw state and only takes the new psuedo ctm.
+    bool updateContext(const GMatrix& new_ctm) {
+        float det = new_ctm[0] * new_ctm[4] - new_ctm[1] * new_ctm[3];
+        if (det == 0) return false;
+        return realShader->updateContext(new_ctm * pseudo_matrix());
+    }
+
+    // The realShader was given the whole device --> texture mapping by setContext().
+    bool isRowConstant() {
+        return realShader->isRowConstant();
+    }
+
+    // Likewise for rows that are all the same.
+    bool isColumnConstant() {
+        return realShader->isColumnConstant();
+    }
+
+    // The realShader's stages already map device space through P and S.
+    bool appendStages(RasterPipeline* pipeline) {
+        return realShader->appendStages(pipeline);
+    }
+
+    // The realShader interpolates with the requested precision.
+    void setPrecision(Precision precision) {
+        realShader->setPrecision(precision);
+    }
+
+    // The realShader reads the changed pixels.
+    void notifyPixelsChanged() {
+        realShader->notifyPixelsChanged();
     }
 
     /**
@@ -65,6 +75,32 @@ class ProxyShader: public GShader {
     }
 
     private:
+        // Returns P * S^-1, which maps the requested S coordinates onto the points P.
+        GMatrix pseudo_matrix() const {
+            // Defining points.
+            GPoint p0 = pts[0];
+            GPoint p1 = pts[1];
+            GPoint p2 = pts[2];
+
+            GPoint s0 = coords[0];
+            GPoint s1 = coords[1];
+            GPoint s2 = coords[2];
+
+            // Creating the P matrix.
+            GMatrix P = {
+                (p1-p0).fX, (p2-p0).fX, p0.fX,
+                (p1-p0).fY, (p2-p0).fY, p0.fY
+            };
+
+            // Creating the S^-1 matrix.
+            GMatrix S = {
+                (s1-s0).fX, (s2-s0).fX, s0.fX,
+                (s1-s0).fY, (s2-s0).fY, s0.fY
+            };
+            S.invert(&S);
+            return P * S;
+        }
+
         GShader* realShader;
         const GPoint* pts;
         const GPoint* coords;
@@ -0,0 +1,219 @@
+#include <RasterPipeline.h>
+#include <GShader.h>
+#include <Simd.h>
+#include <algorithm>
+#include <cstring>
+
+// fx, fy = the device pixel centers of the pass.
+static void seed(RasterPipeline::Lanes& lanes, const void*) {
+    for (int i = 0; i < lanes.count; i++) {
+        lanes.fx[i] = lanes.x + i + 0.5f;
+        lanes.fy[i] = lanes.y + 0.5f;
+    }
+}
+
+// fx, fy = matrix * (fx, fy).
+static void transform(RasterPipeline::Lanes& lanes, const void* ctx) {
+    const GMatrix& m = *(const GMatrix*)ctx;
+    for (int i = 0; i < lanes.count; i++) {
+        float x = lanes.fx[i];
+        float y = lanes.fy[i];
+        lanes.fx[i] = m[0] * x + m[1] * y + m[2];
+        lanes.fy[i] = m[3] * x + m[4] * y + m[5];
+    }
+}
+
+// r, g, b *= a.
+static void premul(RasterPipeline::Lanes& lanes, const void*) {
+    for (int i = 0; i < lanes.count; i++) {
+        lanes.r[i] *= lanes.a[i];
+        lanes.g[i] *= lanes.a[i];
+        lanes.b[i] *= lanes.a[i];
+    }
+}
+
+// pixels = the shader's own row.
+static void shade_row(RasterPipeline::Lanes& lanes, const void* ctx) {
+    ((GShader*)ctx)->shadeRow(lanes.x, lanes.y, lanes.count, lanes.pixels);
+}
+
+// r, g, b, a = pixels.
+static void unpack_pixels(RasterPipeline::Lanes& lanes, const void*) {
+    RasterPipeline::unpack(lanes);
+}
+
+// Copies r, g, b, a into the slot.
+static void save(RasterPipeline::Lanes& lanes, const void* ctx) {
+    RasterPipeline::Slot* slot = (RasterPipeline::Slot*)ctx;
+    memcpy(slot->r, lanes.r, lanes.count * sizeof(float));
+    memcpy(slot->g, lanes.g, lanes.count * sizeof(float));
+    memcpy(slot->b, lanes.b, lanes.count * sizeof(float));
+    memcpy(slot->a, lanes.a, lanes.count * sizeof(float));
+}
+
+// dst = r, g, b, a.
+static void store(RasterPipeline::Lanes& lanes, const void*) {
+    RasterPipeline::pack(lanes, lanes.dst);
+}
+
+// dst = pixels.
+static void store_pixels(RasterPipeline::Lanes& lanes, const void*) {
+    memcpy(lanes.dst, lanes.pixels, lanes.count * sizeof(GPixel));
+}
+
+// dst = blend(r, g, b, a, dst).
+static void blend(RasterPipeline::Lanes& lanes, const void* ctx) {
+    RasterPipeline::pack(lanes, lanes.pixels);
+    (*(const blend_row_proc*)ctx)(lanes.dst, lanes.pixels, lanes.count);
+}
+
+// dst = blend(pixels, dst).
+static void blend_pixels(RasterPipeline::Lanes& lanes, const void* ctx) {
+    (*(const blend_row_proc*)ctx)(lanes.dst, lanes.pixels, lanes.count);
+}
+
+void RasterPipeline::append(StageFn fn, const void* ctx) {
+    if (holds_pixels) push(unpack_pixels, nullptr);
+    holds_pixels = false;
+    push(fn, ctx);
+}
+
+void RasterPipeline::push(StageFn fn, const void* ctx) {
+    // Growing moves the stages to a bigger arena array; the old one is freed with the draw.
+    if (stage_count == stage_capacity) {
+        stage_capacity = std::max(kMinStages, 2 * stage_capacity);
+        Stage* grown = arena.make<Stage>(stage_capacity);
+        std::copy(stages, stages + stage_count, grown);
+        stages = grown;
+    }
+    stages[stage_count++] = { fn, ctx };
+}
+
+void RasterPipeline::appendPixels(StageFn fn, const void* ctx) {
+    push(fn, ctx);
+    holds_pixels = true;
+}
+
+// Seeding and transforming only touch fx and fy, so pixels stay packed across them.
+void RasterPipeline::appendSeed() {
+    push(seed, nullptr);
+}
+
+void RasterPipeline::appendTransform(const GMatrix* matrix) {
+    push(transform, matrix);
+}
+
+void RasterPipeline::appendPremul() {
+    append(premul);
+}
+
+void RasterPipeline::appendShadeRow(GShader* shader) {
+    appendPixels(shade_row, shader);
+}
+
+void RasterPipeline::appendSave(Slot* slot) {
+    append(save, slot);
+}
+
+void RasterPipeline::appendStore() {
+    push(holds_pixels ? store_pixels : store, nullptr);
+}
+
+void RasterPipeline::appendBlend(blend_row_proc blend_row) {
+    blend_proc = blend_row;
+    push(holds_pixels ? blend_pixels : blend, &blend_proc);
+}
+
+void RasterPipeline::run(int x, int y, int count, GPixel dst[]) {
+    Lanes lanes;
+    lanes.y = y;
+    for (int start = 0; start < count; start += kLanes) {
+        lanes.x = x + start;
+        lanes.count = std::min(kLanes, count - start);
+        lanes.dst = dst + start;
+        for (int i = 0; i < stage_count; i++) {
+            stages[i].fn(lanes, stages[i].ctx);
+        }
+    }
+}
+
+/**
+ * Unpacking divides by 255 and packing pins to [0, 1] and rounds x * 255 with +0.5, the same way
+ * color_to_pixel() does, so an unpacked pixel packs back to itself.
+ */
+void RasterPipeline::unpack(Lanes& lanes) {
+    int i = 0;
+#if defined(G_SIMD_SSE2)
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    const __m128 scale = _mm_set1_ps(1.0f / 255);
+    for (; i + 4 <= lanes.count; i += 4) {
+        __m128i p = _mm_loadu_si128((const __m128i*)(lanes.pixels + i));
+        _mm_storeu_ps(lanes.a + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(p, GPIXEL_SHIFT_A)), scale));
+        _mm_storeu_ps(lanes.r + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, GPIXEL_SHIFT_R), mask)), scale));
+        _mm_storeu_ps(lanes.g + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, GPIXEL_SHIFT_G), mask)), scale));
+        _mm_storeu_ps(lanes.b + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, GPIXEL_SHIFT_B), mask)), scale));
+    }
+#endif
+    for (; i < lanes.count; i++) {
+        GPixel p = lanes.pixels[i];
+        lanes.a[i] = GPixel_GetA(p) * (1.0f / 255);
+        lanes.r[i] = GPixel_GetR(p) * (1.0f / 255);
+        lanes.g[i] = GPixel_GetG(p) * (1.0f / 255);
+        lanes.b[i] = GPixel_GetB(p) * (1.0f / 255);
+    }
+}
+
+#if defined(G_SIMD_SSE2)
+// floor(x * 255 + 0.5) on four lanes pinned to [0, 1], exact like the double math of the scalar
+// loops; see the rounding note in ColorConvert.cpp.
+static inline __m128i round255(__m128 x) {
+    x = _mm_min_ps(_mm_max_ps(x, _mm_setzero_ps()), _mm_set1_ps(1));
+    x = _mm_mul_ps(x, _mm_set1_ps(255));
+    __m128i i = _mm_cvttps_epi32(x);
+    __m128 half = _mm_cmpge_ps(_mm_sub_ps(x, _mm_cvtepi32_ps(i)), _mm_set1_ps(0.5f));
+    return _mm_sub_epi32(i, _mm_castps_si128(half));
+}
+#endif
+
+void RasterPipeline::pack(Lanes& lanes, GPixel dst[]) {
+    int i = 0;
+#if defined(G_SIMD_SSE2)
+    for (; i + 4 <= lanes.count; i += 4) {
+        __m128i a = round255(_mm_loadu_ps(lanes.a + i));
+        __m128i r = round255(_mm_loadu_ps(lanes.r + i));
+        __m128i g = round255(_mm_loadu_ps(lanes.g + i));
+        __m128i b = round255(_mm_loadu_ps(lanes.b + i));
+        __m128i p = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(a, GPIXEL_SHIFT_A), _mm_slli_epi32(r, GPIXEL_SHIFT_R)),
+                                 _mm_or_si128(_mm_slli_epi32(g, GPIXEL_SHIFT_G), _mm_slli_epi32(b, GPIXEL_SHIFT_B)));
+        _mm_storeu_si128((__m128i*)(dst + i), p);
+    }
+#endif
+    for (; i < lanes.count; i++) {
+        dst[i] = GPixel_PackARGB(
+            GPinToUnit(lanes.a[i]) * 255 + 0.5,
+            GPinToUnit(lanes.r[i]) * 255 + 0.5,
+            GPinToUnit(lanes.g[i]) * 255 + 0.5,
+            GPinToUnit(lanes.b[i]) * 255 + 0.5
+        );
+    }
+}
+
+void RasterPipeline::unpack(const GPixel src[], Slot* slot, int count) {
+    for (int i = 0; i < count; i++) {
+        slot->a[i] = GPixel_GetA(src[i]) * (1.0f / 255);
+        slot->r[i] = GPixel_GetR(src[i]) * (1.0f / 255);
+        slot->g[i] = GPixel_GetG(src[i]) * (1.0f / 255);
+        slot->b[i] = GPixel_GetB(src[i]) * (1.0f / 255);
+    }
+}
+
+void RasterPipeline::pack(const Slot* slot, GPixel dst[], int count) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = GPixel_PackARGB(
+            slot->a[i] * 255 + 0.5,
+            slot->r[i] * 255 + 0.5,
+            slot->g[i] * 255 + 0.5,
+            slot->b[i] * 255 + 0.5
+        );
+    }
+}
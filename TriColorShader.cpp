@@ -2,8 +2,8 @@
 #include <GColor.h>
 #include <GMatrix.h>
 #include <GShader.h>
-
-GPixel color_to_pixel(GColor color);
+#include <ColorConvert.h>
+#include <Lowp.h>
 
 /**
  * This shader's job is to take three points, each with a color payload.
@@ -31,7 +31,7 @@ class TriColorShader: public GShader {
     // Return true iff all of the GPixels that may be returned by this shader will be opaque.
     bool isOpaque() {
         for (int i = 0; i < 3; i++) {
-            if (!(colors + i)->fA) {
+            if ((colors + i)->fA < 1) {
                 return false;
             }
         }
@@ -65,12 +65,14 @@ class TriColorShader: public GShader {
         float G = (-a - d) * c0.fG + a*c1.fG + d*c2.fG;
         float B = (-a - d) * c0.fB + a*c1.fB + d*c2.fB;
         delta_color = GColor::MakeARGB(A, R, G, B);
-
-        // Setting new ctm and returning true.
-        ctm = new_ctm;
         return true;
     }
 
+    // Lowp interpolation is only used when the kernels exist on this target.
+    void setPrecision(Precision precision) {
+        use_lowp = precision == kLowp_Precision && lowp_supported();
+    }
+
     void shadeRow(int x, int y, int count, GPixel row[]) {
         // Defining colors.
         GColor c0 = colors[0];
@@ -92,17 +94,11 @@ class TriColorShader: public GShader {
         float B = (1 - P.fX - P.fY) * c0.fB + P.fX*c1.fB + P.fY*c2.fB;
         GColor c = GColor::MakeARGB(A, R, G, B);
 
-        for (int i = 0; i < count; i++) {
-            // Saving new pixel.
-            row[i] = color_to_pixel(c);
-
-            // Incrementing.
-            c = GColor::MakeARGB(
-                delta_color.fA + c.fA,
-                delta_color.fR + c.fR,
-                delta_color.fG + c.fG,
-                delta_color.fB + c.fB
-            );
+        // The whole row is one linear ramp; every pixel is computed from c and its index.
+        if (use_lowp) {
+            lowp_ramp_to_pixels(row, c, delta_color, count);
+        } else {
+            ramp_to_pixels(row, c, delta_color, count);
         }
     }
 
@@ -111,20 +107,10 @@ class TriColorShader: public GShader {
         const GColor* colors;
         GMatrix local_matrix;
         GMatrix inverse_matrix;
-        GMatrix ctm;
         GColor delta_color;
+        bool use_lowp = false;
 };
 
-// Takes a color and transforms it into a premul pixel.
-GPixel color_to_pixel(GColor color) {
-    return GPixel_PackARGB(
-        color.fA * 255 + 0.5,
-        color.fA * color.fR * 255 + 0.5,
-        color.fA * color.fG * 255 + 0.5,
-        color.fA * color.fB * 255 + 0.5
-    );
-}
-
 /**
  *  Return a subclass of GShader that takes a triangle with color payload and draws them.
  */
@@ -0,0 +1,96 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+/**
+ * A bump allocator for the transient memory of draws: edges, flattened curve points,
+ * tessellated vertices and scratch rows.
+ *
+ * Allocation moves a pointer through a list of blocks. A draw takes a mark() on entry and
+ * rewinds() to it on exit, so the blocks are reused by every later draw and nothing is freed
+ * per draw. When a block runs out, a bigger one is added; reset() at a frame boundary folds
+ * the blocks into one big enough for the largest frame so far.
+ */
+class Arena {
+    public:
+
+    // Where the arena was at some point; rewinding to it frees everything allocated since.
+    struct Mark {
+        size_t block;
+        size_t offset;
+    };
+
+    Arena() {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    /**
+     * Returns uninitialized storage for [count] T's, valid until the arena is rewound past it.
+     * T is never destroyed, so it must be trivially copyable and destructible.
+     */
+    template <typename T> T* make(size_t count) {
+        static_assert(std::is_trivially_copyable<T>::value && std::is_trivially_destructible<T>::value,
+                      "arena objects are never constructed or destroyed");
+        return (T*)this->alloc(count * sizeof(T), alignof(T));
+    }
+
+    Mark mark() const {
+        return { current, offset };
+    }
+
+    // Frees everything allocated since [mark]. The blocks stay for later allocations.
+    void rewind(const Mark& mark) {
+        current = mark.block;
+        offset = mark.offset;
+    }
+
+    /**
+     * Frees everything. If the allocations since the last reset() needed more than one block,
+     * they are replaced by a single block of the high-water mark.
+     */
+    void reset();
+
+    // The most bytes that have been in use at once.
+    size_t highWaterMark() const {
+        return high_water;
+    }
+
+    private:
+        struct Block {
+            std::unique_ptr<char[]> storage;
+            size_t size;
+            size_t used;    // the bytes allocated when the arena last moved past this block.
+        };
+
+        // The smallest block; a typical draw fits in one.
+        static constexpr size_t kMinBlockSize = 64 * 1024;
+
+        void* alloc(size_t bytes, size_t alignment);
+
+        std::vector<Block> blocks;
+        size_t current = 0;         // the block being allocated from.
+        size_t offset = 0;          // the next free byte of that block.
+        size_t high_water = 0;
+};
+
+/**
+ * Rewinds an arena to where it was when the scope was entered. Every draw opens one, so a draw
+ * nested in another (drawQuad -> drawMesh) keeps its caller's allocations.
+ */
+class ArenaScope {
+    public:
+
+    ArenaScope(Arena& _arena) : arena(_arena), mark(_arena.mark()) {}
+    ~ArenaScope() {
+        arena.rewind(mark);
+    }
+
+    private:
+        Arena& arena;
+        Arena::Mark mark;
+};
+
+#endif
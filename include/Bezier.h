@@ -3,39 +3,32 @@
 #include <GPoint.h>
 
 /**
- * Calculates #segments for quadratic bezier curves.
- * T = 0.25. 
- */ 
-int quadSegments(GPoint pts[]);
-
-/**
- * Calculates #segments for cubic bezier curves.
- * T = 0.25. 
+ * How far, in pixels, a flattened curve may stray from the true curve by default.
  */
-int cubicSegments(GPoint pts[]);
+const float kCurveTolerance = 0.25f;
 
 /**
- * Calculates a point on a quadratic bezier curve.
- * 
- * R(t) = (1 - t)^2 * A + 2t(1 -t) * B + t^2 * C.
+ * Calculates #segments for quadratic bezier curves, so the lines stay within [tolerance]
+ * of the curve.
  */
-GPoint calculateQuad(GPoint A, GPoint B, GPoint C, float t);
+int quadSegments(const GPoint pts[], float tolerance = kCurveTolerance);
 
 /**
- * Calculates a point on a cubic bezier curve.
- * 
- * R(t) = (1 - t)^3 * A + 3t(1 - t)^2 * B + 3*t^2 * (1 - t) * C + t^3 * D.
+ * Calculates #segments for cubic bezier curves, so the lines stay within [tolerance]
+ * of the curve.
  */
-GPoint calculateCubic(GPoint A, GPoint B, GPoint C, GPoint D, float t);
+int cubicSegments(const GPoint pts[], float tolerance = kCurveTolerance);
 
 /**
- * Creates the points on a quadratic bezier and returns them.
+ * Chops a quadratic bezier at its y extremum, so every piece is monotonic in y.
+ * The pieces share their end points in dst[]; returns how many there are (1 or 2).
  */
-void createQuadPts(GPoint pts[], GPoint quadPts[], int count);
+int chopQuadAtYExtrema(const GPoint src[3], GPoint dst[5]);
 
 /**
- *  Creates the points on a cubic bezier and returns them.
+ * Chops a cubic bezier at its y extrema, so every piece is monotonic in y.
+ * The pieces share their end points in dst[]; returns how many there are (1 to 3).
  */
-void createCubicPts(GPoint pts[], GPoint cubicPts[], int count);
+int chopCubicAtYExtrema(const GPoint src[4], GPoint dst[10]);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,69 @@
+#ifndef BLENDSPAN_H
+#define BLENDSPAN_H
+#include <GPixel.h>
+#include <GBlendMode.h>
+
+/**
+ * Divides x in [0, 255 * 255] by 255, rounding to nearest. The span kernels' div255() match it
+ * bit for bit.
+ */
+static inline int Div255(int x) {
+    return ((x + 128) * 257) >> 16;
+}
+
+/**
+ * Blends a row of src pixels into a row of dst pixels: dst[i] = blend(src[i], dst[i]).
+ */
+typedef void (*blend_row_proc)(GPixel dst[], const GPixel src[], int count);
+
+/**
+ * Blends a single src pixel into a row of dst pixels: dst[i] = blend(src, dst[i]).
+ */
+typedef void (*blend_color_proc)(GPixel dst[], GPixel src, int count);
+
+/**
+ * What is known about the alpha of the src pixels before blending.
+ */
+enum SrcAlpha {
+    kZero_SrcAlpha,     // every src pixel is 0.
+    kOpaque_SrcAlpha,   // every src pixel has alpha 255.
+    kPartial_SrcAlpha,  // anything else.
+};
+
+// Classifies a single src pixel.
+static inline SrcAlpha get_src_alpha(GPixel src) {
+    int alpha = GPixel_GetA(src);
+    return alpha == 0 ? kZero_SrcAlpha : alpha == 255 ? kOpaque_SrcAlpha : kPartial_SrcAlpha;
+}
+
+/**
+ * Returns the cheapest blend mode that gives the same result as [blend_mode] for every dst,
+ * given [src_alpha]. e.g. kSrcOver with an opaque src is kSrc, and with a zero src it is kDst.
+ *
+ * Reductions that depend on dst alpha are not needed: the span kernels evaluate the general
+ * formula, which already gives the exact special-case result for opaque or empty dst pixels.
+ */
+GBlendMode reduce_blend_mode(GBlendMode blend_mode, SrcAlpha src_alpha);
+
+/**
+ * Returns the span blender for [blend_mode] after reducing it by [src_alpha]. The kernel works
+ * on 4 (SSE2) or 8 (AVX2) pixels at a time, chosen for the running CPU, and falls back to scalar
+ * code otherwise. kSrc, kDst and kClear are plain copies, no-ops and clears.
+ *
+ * Pick the proc once per draw; the kernels never branch on pixel values.
+ */
+blend_row_proc get_blend_row(GBlendMode blend_mode, SrcAlpha src_alpha = kPartial_SrcAlpha);
+
+/**
+ * Same as get_blend_row(), but for a constant src pixel (solid color fills). The mode is
+ * reduced by the alpha of [src].
+ */
+blend_color_proc get_blend_color(GBlendMode blend_mode, GPixel src);
+
+/**
+ * Same as above, for src pixels that are only known to be [src_alpha], e.g. the colors of a
+ * shader whose rows are each one color.
+ */
+blend_color_proc get_blend_color(GBlendMode blend_mode, SrcAlpha src_alpha);
+
+#endif
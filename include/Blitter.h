@@ -1,23 +1,51 @@
 #include <GMatrix.h>
 #include <GShader.h>
+#include <BlendSpan.h>
+#include <RasterPipeline.h>
+#include <Arena.h>
+#include <cstring>
 
-typedef GPixel (*blend_mode)(GPixel& src, GPixel& dst);
 class GMatrix;
 class GShader;
 
 class Blitter {
     public:
-    bool local_dest_set = false;
 
     // Constructor.
-    Blitter(const GPaint _src, const GBitmap& _bit_map, GMatrix _ctm) {
+    // Scratch rows and stage storage come from [arena], so the blitter must not outlive the
+    // draw's arena scope.
+    Blitter(const GPaint _src, const GBitmap& _bit_map, GMatrix _ctm, GShader::Precision precision, Arena& arena)
+        : pipeline(arena) {
 
         local_src = _src;
-        local_src_pixel = color_to_pixel(_src);
-        local_dst = GPixel_PackARGB(0, 0, 0, 0);
-        blend_ptr = nullptr;
+        local_src_pixel = color_to_pixel(_src.getColor());
+
+        // Setting up the shader's context once for the whole draw.
+        GShader* shader = _src.getShader();
+        if (shader) shader->setPrecision(precision);
+        shader_ready = shader && shader->setContext(_ctm);
+        shader_row_constant = shader_ready && shader->isRowConstant();
+        shader_column_constant = shader_ready && !shader_row_constant && shader->isColumnConstant();
+        shader_row = shader_ready ? arena.make<GPixel>(_bit_map.width()) : nullptr;
+
+        // Picking the span blenders once for the whole draw. An opaque shader reduces the
+        // blend mode, e.g. kSrcOver --> kSrc and kDstIn --> kDst.
+        SrcAlpha shader_alpha = shader && shader->isOpaque() ? kOpaque_SrcAlpha : kPartial_SrcAlpha;
+        shader_mode = reduce_blend_mode(_src.getBlendMode(), shader_alpha);
+        blend_row = get_blend_row(_src.getBlendMode(), shader_alpha);
+        blend_color = get_blend_color(_src.getBlendMode(), local_src_pixel);
+        blend_shader_color = get_blend_color(_src.getBlendMode(), shader_alpha);
         bit_map = _bit_map;
-        ctm = _ctm;
+
+        // Compiling the shader's stages, ending in a store (or a blend) into dst.
+        shader_pipeline = shader_ready && shader->appendStages(&pipeline);
+        if (shader_pipeline) {
+            if (shader_mode == GBlendMode::kSrc) {
+                pipeline.appendStore();
+            } else {
+                pipeline.appendBlend(blend_row);
+            }
+        }
     }
 
     /*
@@ -30,57 +58,123 @@ class Blitter {
     * end_x: integer of the end of the row.
     */
     void blit(int y, int start_x, int end_x) {
+        int count = end_x - start_x;
+        assert(count >= 0);
+        if (count == 0) return;
+
+        // Destination row.
+        GPixel* dst = bit_map.getAddr(start_x, y);
+
         // Shading + blitting.
-        if (local_src.getShader() && local_src.getShader()->setContext(ctm)) {
-            // Set a new array for the pixels.
-            int count = end_x - start_x;
-            assert(count >= 0);
-            GPixel new_pixels[count];
+        if (shader_ready) {
+            // The whole row is one color, so blit it like a solid paint.
+            if (shader_row_constant) {
+                GPixel pixel;
+                local_src.getShader()->shadeRow(start_x, y, 1, &pixel);
+                blend_shader_color(dst, pixel, count);
+                return;
+            }
 
-            // Retrieving the pixels from the shader's location.
-            local_src.getShader()->shadeRow(start_x, y, count, new_pixels);
-
-            // Blitting using the shader's pixels.
-            for (int x = start_x; x < end_x; x++) {
-                // Pixels from shadeRow.
-                GPixel new_src = new_pixels[x - start_x];
-                GPixel dst = *bit_map.getAddr(x, y);
-                *bit_map.getAddr(x, y) = get_blendmode_pixel(new_src, dst, local_src.getBlendMode());
+            // The shader's pixels would not change dst.
+            if (shader_mode == GBlendMode::kDst) return;
+
+            // The shader's pixels are never read.
+            if (shader_mode == GBlendMode::kClear) {
+                blend_row(dst, nullptr, count);
+                return;
+            }
+
+            // Every row is the same, so spans are read out of one shaded device row.
+            if (shader_column_constant) {
+                const GPixel* src = cached_row(y, start_x, end_x);
+                if (shader_mode == GBlendMode::kSrc) {
+                    memcpy(dst, src, count * sizeof(GPixel));
+                } else {
+                    blend_row(dst, src, count);
+                }
+                return;
+            }
+
+            // The shader's stages shade and blend the span in one go.
+            if (shader_pipeline) {
+                pipeline.run(start_x, y, count, dst);
+                return;
+            }
+
+            // The shader's pixels replace dst, so shade straight into it.
+            if (shader_mode == GBlendMode::kSrc) {
+                local_src.getShader()->shadeRow(start_x, y, count, dst);
+                return;
             }
 
+            // Retrieving the pixels from the shader's location.
+            local_src.getShader()->shadeRow(start_x, y, count, shader_row);
+
+            // Blitting the whole span using the shader's pixels.
+            blend_row(dst, shader_row, count);
+
         // Normal blitting.
         } else {
-            for (int x = start_x; x < end_x; x++) {
-                GPixel dst = *bit_map.getAddr(x, y);
-                set_blend_mode(dst);
-                *bit_map.getAddr(x, y) = blend_ptr(local_src_pixel, dst);
-            }
+            blend_color(dst, local_src_pixel, count);
         }
     }
 
     /*
-    * Set a new blend mode if the dst value has changed. If the dst value has changed, set local_dst to it.
+    * Colors every pixel inside an integer rectangle.
     *
-    * dst: GPixel that will be compared to the local dst given.
-    * 
-    * returns true if the local_dst and blend ptr has been changed and false otherwise.
+    * rect: GIRect of pixels to color; must lie inside the bit_map.
     */
-    bool set_blend_mode(GPixel dst) {
-        if (!local_dest_set || GPixel_GetA(local_dst) != GPixel_GetA(dst)) {
-            local_dest_set = true;
-            local_dst = dst;
-            blend_ptr = get_blendmode(local_src, dst);
-            return true;
-        } else {
-            return false;
+    void blit_rect(const GIRect& rect) {
+        assert(rect.left() >= 0 && rect.right() <= bit_map.width());
+        assert(rect.top() >= 0 && rect.bottom() <= bit_map.height());
+
+        // Solid fills over full-width rows of a tightly packed bit_map are one contiguous span.
+        if (!local_src.getShader() && rect.width() == bit_map.width() &&
+            bit_map.rowBytes() == bit_map.width() * sizeof(GPixel)) {
+            blend_color(bit_map.getAddr(0, rect.top()), local_src_pixel, rect.width() * rect.height());
+            return;
+        }
+
+        for (int y = rect.top(); y < rect.bottom(); y++) {
+            blit(y, rect.left(), rect.right());
         }
     }
 
     private:
+        /*
+        * Returns shader_row + start_x after making sure it holds the shader's pixels for
+        * [start_x, end_x). Only the pixels that were not shaded yet are shaded.
+        */
+        const GPixel* cached_row(int y, int start_x, int end_x) {
+            if (cached_left == cached_right) {
+                cached_left = start_x;
+                cached_right = start_x;
+            }
+            GShader* shader = local_src.getShader();
+            if (start_x < cached_left) {
+                shader->shadeRow(start_x, y, cached_left - start_x, shader_row + start_x);
+                cached_left = start_x;
+            }
+            if (end_x > cached_right) {
+                shader->shadeRow(cached_right, y, end_x - cached_right, shader_row + cached_right);
+                cached_right = end_x;
+            }
+            return shader_row + start_x;
+        }
+
         GBitmap bit_map; 
-        GPixel (*blend_ptr)(GPixel& src, GPixel& dst);
-        GPixel local_dst;
+        blend_row_proc blend_row;
+        blend_color_proc blend_color;
+        blend_color_proc blend_shader_color;   // for rows of a row-constant shader.
         GPaint local_src;
         GPixel local_src_pixel;
-        GMatrix ctm;
+        GBlendMode shader_mode;
+        bool shader_ready;
+        bool shader_row_constant;
+        bool shader_column_constant;
+        bool shader_pipeline;
+        GPixel* shader_row;     // one device row of shader pixels.
+        int cached_left = 0;    // for column-constant shaders, shader_row holds the pixels
+        int cached_right = 0;   // of [cached_left, cached_right) of every row.
+        RasterPipeline pipeline;
 };
\ No newline at end of file
@@ -0,0 +1,44 @@
+#ifndef COLORCONVERT_H
+#define COLORCONVERT_H
+#include <GColor.h>
+#include <GPixel.h>
+
+/**
+ * Takes an unpremul color and transforms it into a premul pixel.
+ *
+ * Each component is pinned to [0, 1], then rounded with +0.5 and truncated; the batch versions
+ * below give the exact same pixels.
+ */
+static inline GPixel color_to_pixel(const GColor& unpinned) {
+    GColor color = unpinned.pinToUnit();
+    return GPixel_PackARGB(
+        color.fA * 255 + 0.5,
+        color.fA * color.fR * 255 + 0.5,
+        color.fA * color.fG * 255 + 0.5,
+        color.fA * color.fB * 255 + 0.5
+    );
+}
+
+/**
+ * Transforms [count] unpremul colors into premul pixels.
+ */
+void colors_to_pixels(GPixel dst[], const GColor src[], int count);
+
+/**
+ * Same as colors_to_pixels(), but the colors are given as one array per component.
+ */
+void lanes_to_pixels(GPixel dst[], const float a[], const float r[], const float g[], const float b[], int count);
+
+/**
+ * Writes premul pixels for a linear color ramp: dst[i] = premul(start + i*delta).
+ */
+void ramp_to_pixels(GPixel dst[], const GColor& start, const GColor& delta, int count);
+
+/**
+ * Looks up each position in [0, 1] in a table of premul pixels spread evenly over [0, 1]:
+ *
+ *  dst[i] = lut[(int)(position[i] * (lut_size - 1) + 0.5)]
+ */
+void lut_to_pixels(GPixel dst[], const GPixel lut[], int lut_size, const float position[], int count);
+
+#endif
@@ -7,6 +7,7 @@
 
 #include "GMatrix.h"
 #include "GPaint.h"
+#include "GShader.h"
 #include <string>
 
 class GBitmap;
@@ -45,6 +46,29 @@ public:
      */
     virtual void concat(const GMatrix& matrix) = 0;
 
+    /**
+     *  Selects the precision shaders interpolate colors with for all following draws.
+     *  kLowp_Precision trades up to 1/255 per channel for speed. The default is kFloat_Precision.
+     */
+    virtual void setShadingPrecision(GShader::Precision) {}
+
+    /**
+     *  Sets how far, in device pixels, the lines that curves are drawn with may stray from the
+     *  curves for all following draws. Larger tolerances draw curves with fewer lines.
+     */
+    virtual void setCurveTolerance(float) {}
+
+    /**
+     *  Marks the end of a frame. Canvases may recycle the scratch memory their draws used
+     *  (edges, flattened curves, tessellated vertices, shader rows) at this point.
+     */
+    virtual void flush() {}
+
+    /**
+     *  Returns the most scratch memory the draws have needed at once, in bytes.
+     */
+    virtual size_t transientHighWaterMark() const { return 0; }
+
     /**
      *  Fill the entire canvas with the specified color, using the specified blendmode.
      */
@@ -149,7 +173,8 @@ public:
 
 /**
  *  If the bitmap is valid for drawing into, this returns a subclass that can perform the
- *  drawing. If bitmap is invalid, this returns NULL.
+ *  drawing. If bitmap is invalid, this returns NULL. Bitmaps wider or taller than 32767
+ *  pixels are invalid.
  */
 std::unique_ptr<GCanvas> GCreateCanvas(const GBitmap& bitmap);
 
@@ -12,6 +12,7 @@
 
 class GBitmap;
 class GMatrix;
+class RasterPipeline;
 
 /**
  *  GShaders create colors to fill whatever geometry is being drawn to a GCanvas.
@@ -24,14 +25,55 @@ public:
         kMirror,
     };
 
+    enum FilterQuality {
+        kNearest_FilterQuality,     // each pixel takes the texel its center falls in.
+        kBilinear_FilterQuality,    // each pixel blends the 2x2 texels around its center.
+    };
+
+    enum Precision {
+        kFloat_Precision,   // colors are interpolated in float.
+        kLowp_Precision,    // colors are interpolated in 16-bit fixed point (within 1/255 of float).
+    };
+
     virtual ~GShader() {}
 
     // Return true iff all of the GPixels that may be returned by this shader will be opaque.
     virtual bool isOpaque() = 0;
 
     // The draw calls in GCanvas must call this with the CTM before any calls to shadeSpan().
+    // It is called once per draw, so shaders cache their per-draw state (inverse matrix,
+    // steps, tables) here and keep shadeRow() down to the per-pixel work.
     virtual bool setContext(const GMatrix& ctm) = 0;
 
+    // Changes the CTM within a draw, after setContext(), e.g. for each triangle of a mesh.
+    // Shaders keep the state that doesn't depend on the matrix (tables, caches) from
+    // setContext() and only redo the mapping. By default the whole context is set up again.
+    virtual bool updateContext(const GMatrix& ctm) { return setContext(ctm); }
+
+    // Returns true if, for the current context, every pixel in a row has the same color,
+    // i.e. shadeRow() only depends on y. The blitter then fills each row with one color.
+    virtual bool isRowConstant() { return false; }
+
+    // Returns true if, for the current context, every row is the same, i.e. shadeRow() only
+    // depends on x. The blitter then shades one device row and reads every span out of it.
+    virtual bool isColumnConstant() { return false; }
+
+    // Appends stages that write this shader's premul colors into the pipeline's lanes.
+    // Called after setContext(). Returns false if the shader has no stages for the current
+    // context; it is then drawn with shadeRow(). Shaders whose shadeRow() already writes packed
+    // pixels with SIMD (bitmaps, gradient tables, color ramps, composes of those) keep it, as it
+    // beats unpacking them into float lanes.
+    virtual bool appendStages(RasterPipeline*) { return false; }
+
+    // Selects the precision shadeRow() interpolates colors with. Called before setContext().
+    // Shaders that don't interpolate colors can ignore it.
+    virtual void setPrecision(Precision) {}
+
+    // Tells the shader that the pixels it reads (e.g. a bitmap's) were changed in place since its
+    // last draw. Shaders that cache data made from those pixels drop it and make it again on the
+    // next draw that needs it. Shaders without such caches can ignore it.
+    virtual void notifyPixelsChanged() {}
+
     /**
      *  Given a row of pixels in device space [x, y] ... [x + count - 1, y], return the
      *  corresponding src pixels in row[0...count - 1]. The caller must ensure that row[]
@@ -43,9 +85,24 @@ public:
 /**
  *  Return a subclass of GShader that draws the specified bitmap and a local matrix.
  *  Returns null if the either parameter is invalid.
+ *
+ *  Bilinear filtering only applies when the pixel centers don't land on texel centers. On
+ *  translated and scaled bitmaps it costs about 1.5-2.5x nearest sampling and about 3x on
+ *  rotated ones.
+ *
+ *  Draws that shrink the bitmap by 2x or more sample a box-filtered mip level instead. The mip
+ *  pyramid is built from the bitmap's pixels on the first such draw and kept by the shader for
+ *  the draws after it.
+ *
+ *  Rotated and skewed draws that sample 512 * 512 texels or more (of the bitmap or of a mip
+ *  level) read a copy stored in 4x4 squares, made on the first such draw and kept likewise.
+ *
+ *  If the bitmap's pixels are changed in place, call notifyPixelsChanged() before drawing with
+ *  the shader again, or it keeps sampling the old pyramid and copies.
  */
 std::unique_ptr<GShader> GCreateBitmapShader(const GBitmap&, const GMatrix& localMatrix,
-                                             GShader::TileMode = GShader::kClamp);
+                                             GShader::TileMode = GShader::kClamp,
+                                             GShader::FilterQuality = GShader::kNearest_FilterQuality);
 
 /**
  *  Return a subclass of GShader that draws the specified gradient of [count] colors between
@@ -68,4 +125,42 @@ static inline std::unique_ptr<GShader> GCreateLinearGradient(GPoint p0, GPoint p
     const GColor colors[] = { c0, c1 };
     return GCreateLinearGradient(p0, p1, colors, 2, mode);
 }
+
+/**
+ *  Return a subclass of GShader that draws a radial gradient of [count] colors. Color[0] is at
+ *  the center, Color[count-1] is on the circle of the given radius, and all intermediate colors
+ *  are evenly spaced between. Past the radius, the colors follow the tile mode.
+ *
+ *  If count < 1 or radius <= 0, this should return nullptr.
+ */
+std::unique_ptr<GShader> GCreateRadialGradient(GPoint center, float radius, const GColor[], int count,
+                                               GShader::TileMode = GShader::kClamp);
+
+/**
+ *  Return a subclass of GShader that draws a sweep gradient of [count] colors around the
+ *  center. Color[0] starts on the positive x axis and the colors turn towards the positive y
+ *  axis, evenly spaced, until Color[count-1] is back on the positive x axis.
+ *
+ *  The tile mode is taken like the other gradients', but one turn covers every angle, so it
+ *  never changes the colors.
+ *
+ *  If count < 1, this should return nullptr.
+ */
+std::unique_ptr<GShader> GCreateSweepGradient(GPoint center, const GColor[], int count,
+                                              GShader::TileMode = GShader::kClamp);
+
+/**
+ *  Return a subclass of GShader that draws a two-point conical gradient of [count] colors.
+ *  Color[0] is on the circle (c0, r0), Color[count-1] is on the circle (c1, r1), and the
+ *  circles in between move their center and radius linearly. Each point takes the color of the
+ *  last circle through it; past the end circles, the colors follow the tile mode. Points on no
+ *  circle with a non-negative radius are left transparent.
+ *
+ *  The radial gradient is the case c0 = c1, r0 = 0.
+ *
+ *  If count < 1, a radius is negative, or the circles are the same, this should return nullptr.
+ */
+std::unique_ptr<GShader> GCreateTwoPointConicalGradient(GPoint c0, float r0, GPoint c1, float r1,
+                                                        const GColor[], int count,
+                                                        GShader::TileMode = GShader::kClamp);
 #endif
@@ -0,0 +1,49 @@
+#ifndef LOWP_H
+#define LOWP_H
+#include <GColor.h>
+#include <GPixel.h>
+
+/**
+ * Low precision ("lowp") color kernels.
+ *
+ * Colors are unpremul with each channel in [0, 1] stored as 1.15 fixed point ([0, 32767]),
+ * in the same b, g, r, a order as the bytes of a GPixel. A 16-bit lane holds twice as many
+ * channels per register as a float, and every output channel stays within 1/255 of the
+ * float path (color_to_pixel() on the same unpremul color).
+ */
+struct LowpColor {
+    int16_t b, g, r, a;
+};
+
+// Converts one channel in [0, 1] to 1.15 fixed point.
+static inline int16_t to_lowp(float x) {
+    return (int16_t)(GPinToUnit(x) * 32767 + 0.5f);
+}
+
+// Converts an unpremul color to 1.15 fixed point.
+static inline LowpColor to_lowp(const GColor& color) {
+    LowpColor c = { to_lowp(color.fB), to_lowp(color.fG), to_lowp(color.fR), to_lowp(color.fA) };
+    return c;
+}
+
+/**
+ * Returns true if the lowp kernels are available on this target. When they aren't, shaders
+ * stay on the float path.
+ */
+bool lowp_supported();
+
+/**
+ * Interpolates between neighbouring colors of a table and writes premul pixels:
+ *
+ *  dst[i] = premul(lerp(colors[index[i]], colors[index[i] + 1], weight[i]))
+ *
+ * weight[] is 1.15 fixed point.
+ */
+void lowp_lerp_to_pixels(GPixel dst[], const LowpColor colors[], const int index[], const int16_t weight[], int count);
+
+/**
+ * Writes premul pixels for a linear color ramp: dst[i] = premul(start + i*delta).
+ */
+void lowp_ramp_to_pixels(GPixel dst[], const GColor& start, const GColor& delta, int count);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef MESH_H
+#define MESH_H
+#include <GBitmap.h>
+#include <GBlendMode.h>
+#include <GColor.h>
+#include <GMatrix.h>
+#include <GPaint.h>
+#include <GPixel.h>
+#include <GPoint.h>
+#include <GShader.h>
+#include <BlendSpan.h>
+#include <Arena.h>
+
+/**
+ * Draws triangle meshes directly, without building a shader or edge list per triangle.
+ *
+ * The vertices are mapped to device space once per draw. Triangles are then set up in
+ * batches: each gets its device-space inverse (pixel center -> barycentric u, v), its color
+ * ramp and its texture matrix. The batch is scan converted one row at a time. The shader is
+ * set up once per draw and only takes each triangle's texture matrix.
+ *
+ * All per-draw storage comes from the canvas' arena, so drawing a mesh costs no heap traffic
+ * once the arena has grown to fit it.
+ */
+class MeshRasterizer {
+    public:
+
+    /**
+     * Draws [count] triangles of [verts] referenced by [indices] into [device], with the
+     * same rules as GCanvas::drawMesh().
+     */
+    void draw(const GBitmap& device, const GMatrix& ctm, const GPoint verts[], const GColor colors[],
+              const GPoint texs[], int count, const int indices[], const GPaint& paint,
+              GShader::Precision precision, Arena& arena);
+
+    private:
+        // A triangle after setup, with its vertices in device space sorted by y.
+        struct Triangle {
+            GPoint top, middle, bottom;
+            int y0, y1;             // rows [y0, y1) on the device.
+            GMatrix inverse;        // device space -> (u, v).
+            GColor origin;          // color at (u, v) = (0, 0).
+            GColor du, dv;          // color change per unit of u and v.
+            GColor dx;              // color change per pixel in x.
+            GMatrix texture;        // ctm for the paint's shader.
+        };
+
+        // Triangles set up at a time; a batch stays in L1/L2 while it is scan converted.
+        static constexpr int kBatch = 256;
+
+        bool setup(Triangle* tri, const int vertex[3], const GColor colors[], const GPoint texs[]) const;
+        void raster(const Triangle& tri, GShader* shader, bool has_colors, bool lowp);
+
+        const GBitmap* dst = nullptr;
+        GBlendMode mode;
+        blend_row_proc blend_row = nullptr;
+        bool shader_ready = false;  // setContext() was called for this draw.
+
+        GPoint* points;         // device-space vertices.
+        Triangle* triangles;    // the current batch.
+        GPixel* row;            // src pixels of a span.
+        GPixel* scratch;        // texture pixels of a span when colors are also drawn.
+};
+
+#endif
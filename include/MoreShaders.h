@@ -1,4 +1,7 @@
+#ifndef MORESHADERS_H
+#define MORESHADERS_H
 #include <GShader.h>
+#include <GBlendMode.h>
 
 /**
  *  Return a subclass of GShader that proxies a real shader.
@@ -10,7 +13,27 @@ std::unique_ptr<GShader> GCreateProxyShader(GShader* _realShader, const GPoint _
  */
 std::unique_ptr<GShader> GCreateComposeShader(GShader* _colorShader, GShader* _gradientShader);
 
+/**
+ *  How a compose shader combines the pixels of its shaders.
+ */
+enum class GComposeOp {
+    kModulate,  // multiplies the components.
+    kAdd,       // adds the components, saturating at 255.
+    kLerp,      // moves from the running result towards the next pixel by [weight].
+    kBlend,     // draws the next pixel over the running result with [mode].
+};
+
+/**
+ *  Return a subclass of GShader that folds the pixels of [count] shaders, left to right, with
+ *  the compose op. [weight] is only used by kLerp and [mode] only by kBlend.
+ *  If count < 1, this returns nullptr.
+ */
+std::unique_ptr<GShader> GCreateComposeShader(GShader* const shaders[], int count, GComposeOp op,
+                                              float weight = 0.5f, GBlendMode mode = GBlendMode::kSrcOver);
+
 /**
  *  Return a subclass of GShader that takes a triangle with color payload and draws them.
  */
-std::unique_ptr<GShader> GCreateTriColorShader(const GPoint _pts[3], const GColor _colors[3]);
\ No newline at end of file
+std::unique_ptr<GShader> GCreateTriColorShader(const GPoint _pts[3], const GColor _colors[3]);
+
+#endif
@@ -1,43 +1,89 @@
 #include <GPoint.h>
-#include <vector>
 #include <GBitmap.h>
+#include <Arena.h>
+#include <GMath.h>
+#include <Simd.h>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
 
 class GBitmap;
 class GPoint;
 float calculate_x(float slope, GPoint point);
 float is_horizontal(float y1, float y2);
 
-// Edge struct for polygons.
+// The largest device width and height edges can address: rows are 16-bit, and x in 16.16
+// fixed point must fit 32 bits. GCreateCanvas() rejects larger devices.
+static constexpr int kMaxDeviceSize = 32767;
+
+// Converts to 16.16 fixed point, pinned to +-kMaxDeviceSize. An edge that is stepped covers
+// two or more rows, so it is more than one row tall and spans at most the device's width:
+// its slope is under kMaxDeviceSize and is never pinned. Steeper edges are one row tall,
+// and are dropped before their stepped x is read.
+static inline int32_t to_fixed(float x) {
+    const double limit = (double)kMaxDeviceSize * 65536;
+    double fixed = floor((double)x * 65536 + 0.5);
+    return (int32_t)std::max(-limit, std::min(fixed, limit));
+}
+
+// Rounds a 16.16 x to the nearest pixel boundary, the same as GRoundToInt() on the float.
+static inline int fixed_round(int32_t x) {
+    return (x + 0x8000) >> 16;
+}
+
+/**
+ * Edge struct for polygons, packed into 16 bytes.
+ *
+ * x and m are 16.16 fixed point, so stepping an edge is an integer add and a span endpoint
+ * is a shift. Rows are 16-bit and x must fit 16.16, which limits devices to kMaxDeviceSize
+ * rows and columns.
+ */
 struct Edge {
-    int   min_y;      // minimum height of the edge.
-    int   max_y;      // maximum height of the edge.
-    int   w;          // winding value.
-    float m;          // Δx / Δy.
-    float x;          // curr_x.
+    int32_t x;        // curr_x.
+    int32_t m;        // Δx / Δy.
+    int16_t min_y;    // minimum height of the edge.
+    int16_t max_y;    // maximum height of the edge.
+    int32_t w;        // winding value.
+
+    // Uninitialized, to be assigned.
+    Edge() = default;
 
     // Constructor.
     Edge(float _min_y, float _max_y, float _m, float _x, int _w, const GBitmap& bit_map) {
-        min_y = GRoundToInt(_min_y);
-        max_y = GRoundToInt(_max_y);
-        m = _m;
-        x = _x;
+        int top = GRoundToInt(_min_y);
+        int bottom = GRoundToInt(_max_y);
+        assert(top < bottom);
+        assert(0 <= top && bottom <= bit_map.height() && bit_map.height() <= kMaxDeviceSize);
+        assert(bit_map.width() <= kMaxDeviceSize);
+        min_y = (int16_t)top;
+        max_y = (int16_t)bottom;
+        m = to_fixed(_m);
+        x = to_fixed(_x);
         w = _w;
-        assert(min_y < max_y);
-        assert(0 <= min_y && max_y <= bit_map.height());
-        assert(0 <= x && x <= (float) bit_map.width());
+        assert(0 <= _x && _x <= (float) bit_map.width());
     }
 
     // Checks if [y] is in y-range of the edge.
     bool legal_y(int y) {
         return min_y <= y && y < max_y;
     }
+
+    // The pixel boundary the edge crosses on the current row.
+    int round_x() const {
+        return fixed_round(x);
+    }
 };
+static_assert(sizeof(Edge) == 16, "Edge should pack into 16 bytes");
 
 /**
- * Takes an array of pts and creates Edges/places them into an Edge vector.
- * Clips any out-of-bound (OOB) points and creates their respective border edge.
+ * Takes an array of pts and creates Edges/places them into [edges], returning how many.
+ * Clips any out-of-bound (OOB) points and creates their respective border edge, so [edges]
+ * needs room for 3 edges per segment.
  */
-void find_edges(std::vector<Edge> &edges, const GPoint pts[], int count, const GBitmap &bit_map, bool connect_end = true) {
+int find_edges(Edge edges[], const GPoint pts[], int count, const GBitmap &bit_map, bool connect_end = true) {
+    int edge_count = 0;
+
     // Iterating through the number of edges in the polygon and placing them into [edges].
     for (int i = 0; i < count; i++) {
         // Index of the next point.
@@ -81,7 +127,7 @@ void find_edges(std::vector<Edge> &edges, const GPoint pts[], int count, const G
                 : bit_map.width();
             
             Edge border_edge = Edge(top_point.fY, bottom_point.fY, 0, bounding_x, w, bit_map);
-            edges.push_back(border_edge);
+            edges[edge_count++] = border_edge;
             continue;
         }
 
@@ -99,7 +145,7 @@ void find_edges(std::vector<Edge> &edges, const GPoint pts[], int count, const G
             // Inserting an edge.
             if (!is_horizontal(edge_min_y, edge_max_y)) {
                 Edge border_edge = Edge(edge_min_y, edge_max_y, 0, 0, w, bit_map);
-                edges.push_back(border_edge);
+                edges[edge_count++] = border_edge;
             }
 
             // The point on the left border is the new left point.
@@ -116,7 +162,7 @@ void find_edges(std::vector<Edge> &edges, const GPoint pts[], int count, const G
             // Inserting an edge.
             if (!is_horizontal(edge_min_y, edge_max_y)) {
                 Edge border_edge = Edge(edge_min_y, edge_max_y, 0, bit_map.width(), w, bit_map);
-                edges.push_back(border_edge);
+                edges[edge_count++] = border_edge;
             }
 
             // The point on the border is now the new right point.
@@ -136,10 +182,157 @@ void find_edges(std::vector<Edge> &edges, const GPoint pts[], int count, const G
 
         // Creating and inserting the final edge.
         Edge edge = Edge(min_y, max_y, m, x, w, bit_map);
-        edges.push_back(edge);
+        edges[edge_count++] = edge;
+    }
+    return edge_count;
+}
+
+// What a curve's control hull says about the edges the curve can make.
+enum HullClip {
+    kVisible_HullClip,  // the hull crosses the bit_map; the curve has to be flattened.
+    kNone_HullClip,     // the hull is above or below the bit_map; the curve covers no rows.
+    kChord_HullClip,    // the hull is left or right of the bit_map; the curve only winds
+                        // along the border, exactly like the line between its end points.
+};
+
+// Classifies the [count] control points of a curve against the bit_map.
+HullClip clip_hull(const GPoint pts[], int count, const GBitmap& bit_map) {
+    float left = pts[0].fX, right = pts[0].fX;
+    float top = pts[0].fY, bottom = pts[0].fY;
+    for (int i = 1; i < count; i++) {
+        left = std::min(left, pts[i].fX);
+        right = std::max(right, pts[i].fX);
+        top = std::min(top, pts[i].fY);
+        bottom = std::max(bottom, pts[i].fY);
     }
+    if (bottom <= 0 || top >= bit_map.height()) return kNone_HullClip;
+    if (right <= 0 || left >= bit_map.width()) return kChord_HullClip;
+    return kVisible_HullClip;
 }
 
+/**
+ * A quadratic or cubic edge, monotonic in y, that the scan conversion steps as a chain of
+ * lines.
+ *
+ * The lines are the curve's flattening, produced by forward differencing one at a time when
+ * the scan line reaches them. Each line is clipped like find_edges() clips a segment: parts
+ * above or below the bit_map are dropped, and parts left or right of it run along the border.
+ */
+struct CurveEdge {
+    GPoint  from;           // where the next line starts.
+    GPoint  to;             // where the current flattened segment ends.
+    GVector d1, d2, d3;     // forward differences of the flattening.
+    GPoint  end;            // the last point of the curve.
+    int     segments;       // flattened segments not started yet.
+    int     w;              // winding value.
+
+    /**
+     * Sets up the curve from its [order] + 1 control points, flattened into [count] lines.
+     * Writes its first line to [edge]; returns false if the curve crosses no rows.
+     */
+    bool setup(const GPoint pts[], int order, int count, Edge* edge, const GBitmap& bit_map) {
+        // Orienting the curve top to bottom.
+        GPoint p[4];
+        w = pts[order].fY > pts[0].fY ? 1 : -1;
+        for (int i = 0; i <= order; i++) {
+            p[i] = w > 0 ? pts[i] : pts[order - i];
+        }
+
+        /**
+         * P(t) = p0 + a*t + b*t^2 + c*t^3, stepped by h = 1/count:
+         *  quad:  a = 2(p1 - p0), b = p0 - 2p1 + p2, c = 0.
+         *  cubic: a = 3(p1 - p0), b = 3(p0 - 2p1 + p2), c = p3 - p0 + 3(p1 - p2).
+         */
+        GVector a, b, c = { 0, 0 };
+        if (order == 2) {
+            a = 2 * (p[1] - p[0]);
+            b = (p[0] - p[1]) + (p[2] - p[1]);
+        } else {
+            a = 3 * (p[1] - p[0]);
+            b = 3 * ((p[0] - p[1]) + (p[2] - p[1]));
+            c = (p[3] - p[0]) + 3 * (p[1] - p[2]);
+        }
+        float h = 1.0f / count;
+        d1 = a * h + b * (h * h) + c * (h * h * h);
+        d2 = b * (2 * h * h) + c * (6 * h * h * h);
+        d3 = c * (6 * h * h * h);
+
+        from = to = p[0];
+        end = p[order];
+        segments = count;
+        return next(edge, bit_map);
+    }
+
+    // Writes the curve's next line to [edge]; returns false once the curve has no rows left.
+    bool next(Edge* edge, const GBitmap& bit_map) {
+        float width = bit_map.width();
+        float height = bit_map.height();
+        for (;;) {
+            // The curve only moves down, so nothing past the bottom of the bit_map shows.
+            if (from.fY >= height) return false;
+
+            // Forward differencing the next segment; the last one ends exactly on the curve.
+            if (from.fY >= to.fY) {
+                if (segments == 0) return false;
+                from = to;
+                segments--;
+                if (segments == 0) {
+                    to = end;
+                } else {
+                    to = to + d1;
+                    d1 = d1 + d2;
+                    d2 = d2 + d3;
+                }
+                to.fY = std::max(to.fY, from.fY);
+                continue;
+            }
+
+            // Clipping the segment to the rows of the bit_map.
+            GPoint top = from;
+            GPoint bottom = to;
+            float m = (bottom.fX - top.fX) / (bottom.fY - top.fY);
+            if (bottom.fY <= 0) {
+                from = to;
+                continue;
+            }
+            if (top.fY < 0) {
+                top = GPoint::Make(top.fX - m * top.fY, 0);
+            }
+            if (bottom.fY > height) {
+                bottom = GPoint::Make(top.fX + m * (height - top.fY), height);
+            }
+
+            // The line runs until it crosses the left or right border, if it does.
+            GPoint cut = bottom;
+            float x, slope;
+            if (top.fX < 0 || (top.fX == 0 && m < 0)) {
+                x = 0;
+                slope = 0;
+                if (bottom.fX > 0) cut = GPoint::Make(0, top.fY - top.fX / m);
+            } else if (top.fX > width || (top.fX == width && m > 0)) {
+                x = width;
+                slope = 0;
+                if (bottom.fX < width) cut = GPoint::Make(width, top.fY + (width - top.fX) / m);
+            } else {
+                x = calculate_x(m, top);
+                slope = m;
+                if (bottom.fX < 0) {
+                    cut = GPoint::Make(0, top.fY - top.fX / m);
+                } else if (bottom.fX > width) {
+                    cut = GPoint::Make(width, top.fY + (width - top.fX) / m);
+                }
+            }
+            cut.fY = std::min(std::max(cut.fY, top.fY), bottom.fY);
+            from = cut;
+
+            // Skipping lines that cover no rows.
+            if (is_horizontal(top.fY, cut.fY)) continue;
+            *edge = Edge(top.fY, cut.fY, slope, std::min(std::max(x, 0.0f), width), w, bit_map);
+            return true;
+        }
+    }
+};
+
 // Takes an endpoint of an edge and calculates its x value using the given slope.
 float calculate_x(float slope, GPoint point) {
     float h = round(point.fY) - point.fY + 0.5;
@@ -172,11 +365,134 @@ bool sortEdges(const Edge& edge1, const Edge& edge2) {
     return edge1.m < edge2.m;
 }
 
-// Sorting function for edges.
-bool sortEdgesByX(const Edge& edge1, const Edge& edge2) {
-    return edge1.x < edge2.x;
+/**
+ * Returns the order of [edges] by min_y, from a counting sort over the rows of the bit_map.
+ * Edges that start on the same row keep their order.
+ */
+int* bucket_edges(const Edge edges[], int count, const GBitmap& bit_map, Arena& arena) {
+    // start[y + 1] counts the edges that begin on row y, then becomes where they are written.
+    int* start = arena.make<int>(bit_map.height() + 1);
+    std::fill(start, start + bit_map.height() + 1, 0);
+    for (int i = 0; i < count; i++) {
+        start[edges[i].min_y + 1]++;
+    }
+    for (int y = 1; y <= bit_map.height(); y++) {
+        start[y] += start[y - 1];
+    }
+
+    int* order = arena.make<int>(count);
+    for (int i = 0; i < count; i++) {
+        order[start[edges[i].min_y]++] = i;
+    }
+    return order;
 }
 
+/**
+ * The active edge table of a scan conversion. Each field is its own array, so stepping every
+ * active edge to the next row is one SIMD add over x[] and m[]. When the last row of a line
+ * is done, a curve edge moves on to its next line in place; other edges leave the table. The
+ * arrays are only compacted on rows where some line ends.
+ */
+struct ActiveEdges {
+    int32_t* x;
+    int32_t* m;
+    int* max_y;
+    int* w;
+    int* curve;             // index into curves[], or -1 for lines.
+    int count = 0;
+    int next_end = 0;       // the first row past some line's last one.
+    CurveEdge* curves;
+    const GBitmap& bit_map;
+
+    // Room for [capacity] edges at once.
+    ActiveEdges(Arena& arena, int capacity, CurveEdge _curves[], const GBitmap& _bit_map)
+        : curves(_curves), bit_map(_bit_map) {
+        x = arena.make<int32_t>(capacity);
+        m = arena.make<int32_t>(capacity);
+        max_y = arena.make<int>(capacity);
+        w = arena.make<int>(capacity);
+        curve = arena.make<int>(capacity);
+    }
+
+    void add(const Edge& edge, int edge_curve) {
+        x[count] = edge.x;
+        m[count] = edge.m;
+        max_y[count] = edge.max_y;
+        w[count] = edge.w;
+        curve[count] = edge_curve;
+        next_end = count == 0 ? edge.max_y : std::min(next_end, (int)edge.max_y);
+        count++;
+    }
+
+    /**
+     * Sorts the edges by x. Stepping every edge by a row barely changes their order, so the
+     * insertion sort is close to linear.
+     */
+    void sort_by_x() {
+        for (int i = 1; i < count; i++) {
+            int32_t xi = x[i];
+            if (xi >= x[i - 1]) continue;
+            int32_t mi = m[i];
+            int max_yi = max_y[i];
+            int wi = w[i];
+            int curvei = curve[i];
+            int j = i;
+            for (; j > 0 && xi < x[j - 1]; j--) {
+                x[j] = x[j - 1];
+                m[j] = m[j - 1];
+                max_y[j] = max_y[j - 1];
+                w[j] = w[j - 1];
+                curve[j] = curve[j - 1];
+            }
+            x[j] = xi;
+            m[j] = mi;
+            max_y[j] = max_yi;
+            w[j] = wi;
+            curve[j] = curvei;
+        }
+    }
+
+    // Moves the edges from row y to row y + 1, dropping the ones that end at y + 1.
+    void step(int y) {
+        int i = 0;
+#if defined(G_SIMD_SSE2)
+        for (; i + 4 <= count; i += 4) {
+            __m128i xs = _mm_loadu_si128((const __m128i*)(x + i));
+            __m128i ms = _mm_loadu_si128((const __m128i*)(m + i));
+            _mm_storeu_si128((__m128i*)(x + i), _mm_add_epi32(xs, ms));
+        }
+#endif
+        // Edges on their last row may step out of range; they are dropped below, unread.
+        for (; i < count; i++) {
+            x[i] = (int32_t)((uint32_t)x[i] + (uint32_t)m[i]);
+        }
+
+        if (y + 1 < next_end) return;
+        int kept = 0;
+        next_end = INT_MAX;
+        for (i = 0; i < count; i++) {
+            // A curve's next line starts on the row its last one ended.
+            Edge edge;
+            if (y + 1 == max_y[i] && curve[i] >= 0 && curves[curve[i]].next(&edge, bit_map)) {
+                assert(edge.min_y == y + 1);
+                x[i] = edge.x;
+                m[i] = edge.m;
+                max_y[i] = edge.max_y;
+            }
+            if (y + 1 < max_y[i]) {
+                x[kept] = x[i];
+                m[kept] = m[i];
+                max_y[kept] = max_y[i];
+                w[kept] = w[i];
+                curve[kept] = curve[i];
+                next_end = std::min(next_end, max_y[i]);
+                kept++;
+            }
+        }
+        count = kept;
+    }
+};
+
 /**
  * Creates a point on a polygon.
  * 
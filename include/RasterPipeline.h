@@ -0,0 +1,123 @@
+#ifndef RASTERPIPELINE_H
+#define RASTERPIPELINE_H
+#include <GPixel.h>
+#include <GMatrix.h>
+#include <BlendSpan.h>
+#include <Arena.h>
+
+class GShader;
+
+/**
+ * A shaded draw compiled into a flat list of stage functions.
+ *
+ * A span is run in passes of up to kLanes pixels. Each stage works on every lane of the pass
+ * (the loops are written so the compiler keeps 4 or 8 lanes per register) before the next
+ * stage runs, so a pass never leaves L1 and there are no per-pixel virtual calls.
+ *
+ * Between stages, the lanes hold pixel coordinates in fx/fy and premul colors in r/g/b/a.
+ * A typical list is: seed, transform, interpolate, premul, store/blend.
+ *
+ * Shaders without stages run their shadeRow() as a stage that leaves packed pixels in
+ * lanes.pixels. The pipeline only unpacks them when a later stage reads r/g/b/a, so pixels
+ * on their way to store or blend are never converted.
+ */
+class RasterPipeline {
+    public:
+
+    // Pixels per pass.
+    static constexpr int kLanes = 64;
+
+    struct Lanes {
+        int x, y, count;        // the pass covers device pixels [x, x + count) of row y.
+        GPixel* dst;            // the destination of the pass.
+        float fx[kLanes];
+        float fy[kLanes];
+        float r[kLanes];
+        float g[kLanes];
+        float b[kLanes];
+        float a[kLanes];
+        GPixel pixels[kLanes];  // scratch pixels for stages that work on packed pixels.
+    };
+
+    // Colors set aside by save() and read back by a later stage, one lane per pixel.
+    struct Slot {
+        float r[kLanes];
+        float g[kLanes];
+        float b[kLanes];
+        float a[kLanes];
+    };
+
+    typedef void (*StageFn)(Lanes& lanes, const void* ctx);
+
+    // Stages may point into the pipeline, so it stays where it was built. Per-draw storage
+    // comes from [arena], so the pipeline must not outlive the draw's arena scope.
+    RasterPipeline(Arena& _arena) : arena(_arena) {}
+    RasterPipeline(const RasterPipeline&) = delete;
+    RasterPipeline& operator=(const RasterPipeline&) = delete;
+
+    // Adds a stage that reads or writes r, g, b, a. [ctx] must stay alive while the pipeline runs.
+    void append(StageFn fn, const void* ctx = nullptr);
+
+    // Returns uninitialized storage for [count] T's that lives as long as the draw, e.g. the
+    // context of a stage. Nothing per draw has to be kept in the shaders themselves.
+    template <typename T> T* make(size_t count = 1) {
+        return arena.make<T>(count);
+    }
+
+    // Returns a slot for save().
+    Slot* allocSlot() {
+        return make<Slot>();
+    }
+
+    /**
+     * The shared stages.
+     *
+     *  seed:       fx, fy = the device pixel centers of the pass.
+     *  transform:  fx, fy = matrix * (fx, fy).
+     *  premul:     r, g, b *= a.
+     *  shade_row:  pixels = the given shader's shadeRow(), for shaders without stages.
+     *  save:       copies r, g, b, a into a slot.
+     *  store:      packs r, g, b, a (or copies pixels) into dst.
+     *  blend:      blends the packed r, g, b, a (or pixels) into dst with a span blender.
+     */
+    void appendSeed();
+    void appendTransform(const GMatrix* matrix);
+    void appendPremul();
+    void appendShadeRow(GShader* shader);
+    void appendSave(Slot* slot);
+    void appendStore();
+    void appendBlend(blend_row_proc blend_row);
+
+    // Runs every stage over device pixels [x, x + count) of row y, ending in dst[].
+    void run(int x, int y, int count, GPixel dst[]);
+
+    // Converts between lanes.pixels and the color lanes.
+    static void unpack(Lanes& lanes);
+    static void pack(Lanes& lanes, GPixel dst[]);
+    static void unpack(const GPixel src[], Slot* slot, int count);
+    static void pack(const Slot* slot, GPixel dst[], int count);
+
+    private:
+        struct Stage {
+            StageFn fn;
+            const void* ctx;
+        };
+
+        // Stage room in a new pipeline; composed shaders can need more, which comes from the arena.
+        static constexpr int kMinStages = 16;
+
+        // Adds a stage without converting the colors, for stages that don't touch them.
+        void push(StageFn fn, const void* ctx);
+
+        // Adds a stage that writes premul pixels into lanes.pixels instead of r, g, b, a.
+        void appendPixels(StageFn fn, const void* ctx);
+
+        Arena& arena;
+        Stage* stages = nullptr;
+        int stage_count = 0;
+        int stage_capacity = 0;
+        blend_row_proc blend_proc;
+        bool holds_pixels = false;  // the colors are in lanes.pixels after the last stage.
+};
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+/**
+ * Shared helpers for code that picks an instruction set at runtime.
+ *
+ * SSE2 is part of the x86-64 baseline, so it is used whenever the compiler targets it.
+ * AVX2 kernels are compiled with a function-level target (G_BEGIN_AVX2 ... G_END_AVX2)
+ * and are only called after cpu_has_avx2() says the running CPU supports them.
+ */
+
+#if defined(__SSE2__) || defined(_M_X64)
+    #define G_SIMD_SSE2 1
+    #include <immintrin.h>
+#endif
+
+#if defined(G_SIMD_SSE2) && (defined(__GNUC__) || defined(__clang__))
+    #define G_SIMD_AVX2 1
+#endif
+
+#if defined(__clang__)
+    #define G_BEGIN_AVX2 _Pragma("clang attribute push (__attribute__((target(\"avx2\"))), apply_to = function)")
+    #define G_END_AVX2   _Pragma("clang attribute pop")
+#else
+    #define G_BEGIN_AVX2 _Pragma("GCC push_options") _Pragma("GCC target(\"avx2\")")
+    #define G_END_AVX2   _Pragma("GCC pop_options")
+#endif
+
+/**
+ * Returns true if the running CPU can execute the AVX2 kernels.
+ * The cpuid query only happens on the first call.
+ */
+static inline bool cpu_has_avx2() {
+#if defined(G_SIMD_AVX2)
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    return has_avx2;
+#else
+    return false;
+#endif
+}
+
+#endif
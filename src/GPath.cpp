@@ -119,7 +119,7 @@ GPath::Verb GPath::Edger::next(GPoint pts[]) {
     while (fCurrVb < fStopVb) {
         switch (*fCurrVb++) {
             case kMove:
-                if (fPrevVerb == kLine) {
+                if (fPrevVerb >= kLine && fPrevVerb <= kCubic) {
                     pts[0] = fCurrPt[-1];
                     pts[1] = *fPrevMove;
                     do_return = true;